@@ -0,0 +1,285 @@
+/*
+ * Checks that the SIMD paths of count_sides() classify segs the same way as
+ * the int64 rule, over random, collinear and degenerate segs, and that a
+ * build on a thread pool gives the same tree as a serial one. Prints the
+ * first mismatch and exits with 1, or exits with 0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/bsp-builder.h"
+
+#define N_LINES 2000
+#define N_SEGS 64
+
+/* Workers of the pool for parallel builds. */
+#define N_THREADS 8
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void)
+{
+    /* xorshift64, so every run checks the same segs. */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* Map coordinate, with the extremes and zero more often than chance. */
+static int32_t coord(void)
+{
+    switch (rng() % 8) {
+    case 0: return INT16_MIN;
+    case 1: return INT16_MAX;
+    case 2: return 0;
+    default: return (int16_t)rng();
+    }
+}
+
+/**
+ * Side of a seg by the rule documented on count_sides(): 0 for the front,
+ * 1 for the back, 2 for a split.
+ */
+static int reference_side(const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1,
+        const int32_t x, const int32_t y, const int32_t dx, const int32_t dy)
+{
+    const int64_t a = (int64_t)dx * (y0 - y) - (int64_t)dy * (x0 - x);
+    const int64_t b = (int64_t)dx * (y1 - y) - (int64_t)dy * (x1 - x);
+    const bool same_way = ((int64_t)x1 - x0) * dx + ((int64_t)y1 - y0) * dy > 0;
+
+    if (a <= 0 && b <= 0)
+        return a || b || same_way ? 0 : 1;
+    if (a >= 0 && b >= 0)
+        return 1;
+    return 2;
+}
+
+/**
+ * Fill segs for a partition line: random ones, pieces of the line in both
+ * directions, parallel ones just off it, and zero-length ones on and off it.
+ */
+static void fill_segs(int32_t *x0s, int32_t *y0s, int32_t *x1s, int32_t *y1s,
+        const int32_t x, const int32_t y, const int32_t dx, const int32_t dy)
+{
+    for (uint32_t i = 0; i < N_SEGS; i++) {
+        const int32_t t0 = (int32_t)(rng() % 5) - 2, t1 = (int32_t)(rng() % 5) - 2;
+        const int32_t off = (int32_t)(rng() % 3) - 1;
+
+        switch (rng() % 4) {
+        case 0:
+            x0s[i] = coord(); y0s[i] = coord();
+            x1s[i] = coord(); y1s[i] = coord();
+            break;
+        case 1:
+            x0s[i] = x + t0 * dx; y0s[i] = y + t0 * dy;
+            x1s[i] = x + t1 * dx; y1s[i] = y + t1 * dy;
+            break;
+        case 2:
+            x0s[i] = x + t0 * dx + off; y0s[i] = y + t0 * dy;
+            x1s[i] = x + t1 * dx + off; y1s[i] = y + t1 * dy;
+            break;
+        default:
+            x0s[i] = x1s[i] = rng() % 2 ? x + t0 * dx : coord();
+            y0s[i] = y1s[i] = rng() % 2 ? y + t0 * dy : coord();
+            break;
+        }
+    }
+}
+
+/* A maze on a grid of cells, with the arrays of a Map that the builder reads. */
+typedef struct {
+    Map map;
+    uint32_t max_lines;
+} Maze;
+
+static void add_line(Maze *maze, const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1)
+{
+    Map *map = &maze->map;
+    const uint32_t v = map->n_vertices, l = map->n_linedefs;
+    const bool two_sided = rng() % 2;
+
+    map->xs[v] = x0; map->ys[v] = y0;
+    map->xs[v + 1] = x1; map->ys[v + 1] = y1;
+    map->starts[l] = v;
+    map->ends[l] = v + 1;
+    map->right_side_defs[l] = 0;
+    map->left_side_defs[l] = two_sided ? 1 : MAP_NO_SIDEDEF;
+    map->front_sectors[l] = (uint32_t)(rng() % 5);
+    map->back_sectors[l] = two_sided ? (uint32_t)(rng() % 5) : MAP_NO_INDEX;
+    map->n_vertices += 2;
+    map->n_linedefs++;
+}
+
+/**
+ * Build a maze of size x size cells of 64 units: the border, a third of
+ * the inner walls, and a diagonal in a quarter of the cells.
+ */
+static bool make_maze(Maze *maze, const int32_t size)
+{
+    const int32_t o = -size * 32;
+
+    maze->max_lines = (uint32_t)(2 * size * (size + 1) + size * size);
+    maze->map = (Map) { 0 };
+    maze->map.xs = (int32_t *)malloc(2 * (size_t)maze->max_lines * sizeof(int32_t));
+    maze->map.ys = (int32_t *)malloc(2 * (size_t)maze->max_lines * sizeof(int32_t));
+    maze->map.starts = (uint32_t *)malloc(maze->max_lines * sizeof(uint32_t));
+    maze->map.ends = (uint32_t *)malloc(maze->max_lines * sizeof(uint32_t));
+    maze->map.right_side_defs = (uint16_t *)malloc(maze->max_lines * sizeof(uint16_t));
+    maze->map.left_side_defs = (uint16_t *)malloc(maze->max_lines * sizeof(uint16_t));
+    maze->map.front_sectors = (uint32_t *)malloc(maze->max_lines * sizeof(uint32_t));
+    maze->map.back_sectors = (uint32_t *)malloc(maze->max_lines * sizeof(uint32_t));
+    if (!maze->map.xs || !maze->map.ys || !maze->map.starts || !maze->map.ends || !maze->map.right_side_defs
+            || !maze->map.left_side_defs || !maze->map.front_sectors || !maze->map.back_sectors) {
+        fprintf(stderr, "Failed to allocate memory for maze.\n");
+        return 1;
+    }
+    maze->map.n_sectors = 5;
+
+    for (int32_t i = 0; i <= size; i++) {
+        for (int32_t j = 0; j < size; j++) {
+            const bool border = i == 0 || i == size;
+            if (border || rng() % 3 == 0)
+                add_line(maze, o + i * 64, o + j * 64, o + i * 64, o + (j + 1) * 64);
+            if (border || rng() % 3 == 0)
+                add_line(maze, o + j * 64, o + i * 64, o + (j + 1) * 64, o + i * 64);
+        }
+    }
+    for (int32_t i = 0; i < size; i++) {
+        for (int32_t j = 0; j < size; j++) {
+            if (rng() % 4 == 0)
+                add_line(maze, o + i * 64 + 8, o + j * 64 + 5, o + i * 64 + 50, o + j * 64 + 41);
+        }
+    }
+
+    return 0;
+}
+
+static void free_maze(Maze *maze)
+{
+    free(maze->map.xs);
+    free(maze->map.ys);
+    free(maze->map.starts);
+    free(maze->map.ends);
+    free(maze->map.right_side_defs);
+    free(maze->map.left_side_defs);
+    free(maze->map.front_sectors);
+    free(maze->map.back_sectors);
+}
+
+/* Compare segs field by field, since their padding is not set. */
+static bool same_segs(const Seg *a, const Seg *b, const uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        if (a[i].start_vertex != b[i].start_vertex || a[i].end_vertex != b[i].end_vertex
+                || a[i].linedef != b[i].linedef || a[i].sidedef != b[i].sidedef || a[i].sector != b[i].sector
+                || a[i].angle != b[i].angle || a[i].offset != b[i].offset || a[i].direction != b[i].direction)
+            return false;
+    }
+
+    return true;
+}
+
+static bool same_tree(const BspTree *a, const BspTree *b)
+{
+    return a->n_vertices == b->n_vertices && a->n_segs == b->n_segs
+        && a->n_subsectors == b->n_subsectors && a->n_nodes == b->n_nodes
+        && !memcmp(a->xs, b->xs, a->n_vertices * sizeof(int32_t))
+        && !memcmp(a->ys, b->ys, a->n_vertices * sizeof(int32_t))
+        && same_segs(a->segs, b->segs, a->n_segs)
+        && !memcmp(a->subsectors, b->subsectors, a->n_subsectors * sizeof(Subsector))
+        && !memcmp(a->nodes, b->nodes, a->n_nodes * sizeof(Node));
+}
+
+/**
+ * Build mazes with sets above BSP_PARALLEL_SEGS serially and on a pool,
+ * and compare the trees.
+ */
+static bool check_parallel_build(void)
+{
+    static const struct {
+        int32_t size;
+        uint32_t n_candidates;
+    } mazes[] = { { 60, 0 }, { 100, 0 }, { 100, 64 }, { 170, 64 } };
+    ThreadPool pool;
+    bool ret = 1;
+
+    if (create_thread_pool(&pool, N_THREADS))
+        return 1;
+
+    for (size_t i = 0; i < sizeof(mazes) / sizeof(mazes[0]); i++) {
+        Maze maze;
+        BspTree serial = { 0 }, parallel = { 0 };
+
+        if (make_maze(&maze, mazes[i].size)
+                || build_bsp(&maze.map, NULL, mazes[i].n_candidates, &serial)
+                || build_bsp(&maze.map, &pool, mazes[i].n_candidates, &parallel)) {
+            free_bsp(&serial);
+            free_maze(&maze);
+            goto exit_pool;
+        }
+
+        const bool same = same_tree(&serial, &parallel);
+        if (same)
+            printf("build_bsp: %u segs, %u nodes, same on %d threads\n", serial.n_segs, serial.n_nodes, N_THREADS);
+        else
+            fprintf(stderr, "Maze of %d cells, %u candidates: parallel build differs from serial one.\n",
+                    mazes[i].size, mazes[i].n_candidates);
+        free_bsp(&parallel);
+        free_bsp(&serial);
+        free_maze(&maze);
+        if (!same)
+            goto exit_pool;
+    }
+    ret = 0;
+
+exit_pool:
+    destroy_thread_pool(&pool);
+    return ret;
+}
+
+int main(void)
+{
+    /* Window sizes that reach the scalar tail, SSE2 and AVX2 loops alone. */
+    static const uint32_t widths[] = { 1, 2, 3, 4, 5, 8, 13, N_SEGS };
+    int32_t x0s[N_SEGS], y0s[N_SEGS], x1s[N_SEGS], y1s[N_SEGS];
+    int sides[N_SEGS];
+    uint64_t n_checks = 0;
+
+    for (uint32_t l = 0; l < N_LINES; l++) {
+        const int32_t x = coord(), y = coord();
+        int32_t dx = (int16_t)rng() / (int32_t)(1 + rng() % 256);
+        int32_t dy = l % 3 ? (int16_t)rng() / (int32_t)(1 + rng() % 256) : 0;
+        if (!dx && !dy)
+            dx = 1;
+
+        fill_segs(x0s, y0s, x1s, y1s, x, y, dx, dy);
+        for (uint32_t i = 0; i < N_SEGS; i++)
+            sides[i] = reference_side(x0s[i], y0s[i], x1s[i], y1s[i], x, y, dx, dy);
+
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+            for (uint32_t first = 0; first + widths[w] <= N_SEGS; first++) {
+                uint32_t expected[3] = { 0 };
+                for (uint32_t i = first; i < first + widths[w]; i++)
+                    expected[sides[i]]++;
+
+                const SideCounts counts = count_sides(x0s + first, y0s + first, x1s + first, y1s + first,
+                        widths[w], x, y, dx, dy);
+                n_checks++;
+                if (counts.front != expected[0] || counts.back != expected[1] || counts.split != expected[2]) {
+                    fprintf(stderr, "Line (%d,%d)+(%d,%d), segs [%u, %u): got %u/%u/%u, expected %u/%u/%u.\n",
+                            x, y, dx, dy, first, first + widths[w], counts.front, counts.back, counts.split,
+                            expected[0], expected[1], expected[2]);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    printf("count_sides: %llu windows match\n", (unsigned long long)n_checks);
+
+    return check_parallel_build();
+}
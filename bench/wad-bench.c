@@ -0,0 +1,244 @@
+/*
+ * Benchmarks of WAD loading, directory decoding, indexing and lookup over
+ * synthetic WADs. Prints a JSON array with one object per measurement.
+ */
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/wad.h"
+#include "../src/wad-index.h"
+
+#define REPEATS 5
+
+/* Largest synthetic WAD to generate, so the suite fits on small machines. */
+#define MAX_FILE_SIZE (256ull << 20)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void)
+{
+    /* xorshift64, so every run generates the same files. */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void lump_name(char name[8], const uint32_t i)
+{
+    char tmp[9];
+    snprintf(tmp, sizeof(tmp), "L%07X", i & 0xFFFFFFFu);
+    memcpy(name, tmp, 8);
+}
+
+/**
+ * Write a WAD of n_lumps lumps whose sizes vary between 0 and twice
+ * avg_size. PWADs override every tenth lump of the matching IWAD.
+ */
+static uint64_t write_synthetic_wad(const char *path, const char *type,
+        const uint32_t n_lumps, const uint32_t avg_size)
+{
+    FILE *fptr = fopen(path, "wb");
+    if (!fptr) {
+        perror("Failed to create synthetic WAD");
+        exit(1);
+    }
+
+    uint8_t *directory = (uint8_t *)malloc((size_t)n_lumps * WAD_DIRECTORY_SIZE);
+    uint8_t *lump = (uint8_t *)malloc(2 * (size_t)avg_size + 1);
+    if (!directory || !lump) {
+        fprintf(stderr, "Failed to allocate memory for synthetic WAD.\n");
+        exit(1);
+    }
+    memset(lump, 0xA5, 2 * (size_t)avg_size + 1);
+
+    const int pwad = !strcmp(type, "PWAD");
+    uint32_t offset = WAD_HEADER_SIZE;
+    fseek(fptr, WAD_HEADER_SIZE, SEEK_SET);
+    for (uint32_t i = 0; i < n_lumps; i++) {
+        const uint32_t sz = avg_size ? (uint32_t)(rng() % (2 * (uint64_t)avg_size + 1)) : 0;
+        uint8_t *entry = directory + (size_t)i * WAD_DIRECTORY_SIZE;
+
+        fwrite(lump, 1, sz, fptr);
+        memcpy(entry, &offset, 4);
+        memcpy(entry + 4, &sz, 4);
+        lump_name((char *)entry + 8, pwad ? i * 10 : i);
+        offset += sz;
+    }
+    fwrite(directory, WAD_DIRECTORY_SIZE, n_lumps, fptr);
+
+    fseek(fptr, 0, SEEK_SET);
+    fwrite(type, 1, 4, fptr);
+    fwrite(&n_lumps, 4, 1, fptr);
+    fwrite(&offset, 4, 1, fptr);
+    fclose(fptr);
+
+    free(directory);
+    free(lump);
+
+    return (uint64_t)offset + (uint64_t)n_lumps * WAD_DIRECTORY_SIZE;
+}
+
+static int n_reports;
+
+static void report(const char *bench, const uint32_t n_lumps, const uint32_t avg_size,
+        const uint64_t bytes, const uint64_t ns, const uint64_t ops)
+{
+    printf("%s\n  {\"bench\":\"%s\",\"lumps\":%u,\"avg_lump_size\":%u,\"bytes\":%llu,"
+            "\"ns\":%llu,\"ns_per_op\":%.2f,\"mb_per_s\":%.1f}",
+            n_reports++ ? "," : "", bench, n_lumps, avg_size, (unsigned long long)bytes, (unsigned long long)ns,
+            (double)ns / (double)(ops ? ops : 1),
+            ns ? (double)bytes / 1e6 / ((double)ns / 1e9) : 0.0);
+    fflush(stdout);
+}
+
+static uint64_t min_u64(const uint64_t a, const uint64_t b)
+{
+    return a < b ? a : b;
+}
+
+static void bench_wad(const char *iwad_path, const char *pwad_path,
+        const uint32_t n_lumps, const uint32_t avg_size)
+{
+    const uint64_t file_sz = write_synthetic_wad(iwad_path, "IWAD", n_lumps, avg_size);
+    const uint64_t dir_sz = (uint64_t)n_lumps * WAD_DIRECTORY_SIZE;
+    uint64_t t_buffered = UINT64_MAX, t_mapped = UINT64_MAX, t_header = UINT64_MAX;
+    uint64_t t_directory = UINT64_MAX, t_index = UINT64_MAX, t_lookup = UINT64_MAX;
+    uint64_t t_lumps = UINT64_MAX, t_merged = UINT64_MAX;
+    const uint32_t n_lookups = 1000000;
+    volatile uint64_t sink = 0;
+
+    for (int r = 0; r < REPEATS; r++) {
+        WAD wad;
+        Header header;
+        WadIndex index;
+        uint64_t t;
+
+        t = now_ns();
+        if (load_wad(iwad_path, &wad))
+            exit(1);
+        t_buffered = min_u64(t_buffered, now_ns() - t);
+        unload_wad(&wad);
+
+        t = now_ns();
+        if (load_wad_mapped(iwad_path, &wad))
+            exit(1);
+        t_mapped = min_u64(t_mapped, now_ns() - t);
+
+        t = now_ns();
+        if (read_header(&wad, &header))
+            exit(1);
+        t_header = min_u64(t_header, now_ns() - t);
+
+        Directory *directories = (Directory *)malloc((size_t)n_lumps * sizeof(Directory));
+        t = now_ns();
+        if (!directories || read_directories(&wad, &header, directories))
+            exit(1);
+        t_directory = min_u64(t_directory, now_ns() - t);
+        free(directories);
+
+        t = now_ns();
+        if (build_wad_index(&wad, &header, &index))
+            exit(1);
+        t_index = min_u64(t_index, now_ns() - t);
+
+        /* Pack the names up front: lookups are measured, not formatting. */
+        uint64_t keys[1024];
+        for (int i = 0; i < 1024; i++) {
+            char name[9] = { 0 };
+            lump_name(name, (uint32_t)(rng() % n_lumps));
+            keys[i] = pack_lump_name(name);
+        }
+        t = now_ns();
+        for (uint32_t i = 0; i < n_lookups; i++)
+            sink += find_lump_num(&index, keys[i & 1023]);
+        t_lookup = min_u64(t_lookup, now_ns() - t);
+
+        /* Touch every lump through the index, as a level load would. */
+        t = now_ns();
+        for (uint32_t i = 0; i < index.n_lumps; i++) {
+            const WadLump *lump = &index.lumps[i];
+            const uint8_t *data = wad.data + lump->lump_offset;
+            uint64_t sum = 0;
+            for (uint32_t j = 0; j < lump->lump_size; j += 64)
+                sum += data[j];
+            sink += sum;
+        }
+        t_lumps = min_u64(t_lumps, now_ns() - t);
+
+        free_wad_index(&index);
+        unload_wad(&wad);
+    }
+
+    report("load_wad", n_lumps, avg_size, file_sz, t_buffered, n_lumps);
+    report("load_wad_mapped", n_lumps, avg_size, file_sz, t_mapped, n_lumps);
+    report("load_header", n_lumps, avg_size, WAD_HEADER_SIZE, t_header, 1);
+    report("read_directories", n_lumps, avg_size, dir_sz, t_directory, n_lumps);
+    report("build_wad_index", n_lumps, avg_size, dir_sz, t_index, n_lumps);
+    report("find_lump_num", n_lumps, avg_size, 0, t_lookup, n_lookups);
+    report("touch_lumps", n_lumps, avg_size, file_sz - dir_sz, t_lumps, n_lumps);
+
+    /* An IWAD with a PWAD overriding a tenth of its lumps. */
+    write_synthetic_wad(pwad_path, "PWAD", n_lumps / 10, avg_size);
+    for (int r = 0; r < REPEATS; r++) {
+        WAD wads[2];
+        Header headers[2];
+        WadIndex index;
+
+        if (load_wad_mapped(iwad_path, &wads[0]) || load_wad_mapped(pwad_path, &wads[1])
+                || read_header(&wads[0], &headers[0]) || read_header(&wads[1], &headers[1]))
+            exit(1);
+
+        const uint64_t t = now_ns();
+        if (build_merged_wad_index(wads, headers, 2, &index))
+            exit(1);
+        t_merged = min_u64(t_merged, now_ns() - t);
+
+        free_wad_index(&index);
+        unload_wad(&wads[0]);
+        unload_wad(&wads[1]);
+    }
+    report("build_merged_wad_index", n_lumps + n_lumps / 10, avg_size,
+            dir_sz + (uint64_t)(n_lumps / 10) * WAD_DIRECTORY_SIZE,
+            t_merged, n_lumps + n_lumps / 10);
+
+    remove(iwad_path);
+    remove(pwad_path);
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t lump_counts[] = { 1000, 10000, 100000, 1000000 };
+    static const uint32_t lump_sizes[] = { 16, 1024, 16384 };
+    const char *dir = argc > 1 ? argv[1] : ".";
+    char iwad_path[4096], pwad_path[4096];
+
+    snprintf(iwad_path, sizeof(iwad_path), "%s/bench-iwad.wad", dir);
+    snprintf(pwad_path, sizeof(pwad_path), "%s/bench-pwad.wad", dir);
+
+    printf("[");
+    for (size_t i = 0; i < sizeof(lump_counts) / sizeof(lump_counts[0]); i++) {
+        for (size_t j = 0; j < sizeof(lump_sizes) / sizeof(lump_sizes[0]); j++) {
+            if ((uint64_t)lump_counts[i] * lump_sizes[j] > MAX_FILE_SIZE)
+                continue;
+            bench_wad(iwad_path, pwad_path, lump_counts[i], lump_sizes[j]);
+        }
+    }
+
+    printf("\n]\n");
+
+    return 0;
+}
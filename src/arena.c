@@ -0,0 +1,153 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise() */
+
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#else
+#include <windows.h>
+#endif
+
+/* Explicit huge pages are 2 MiB on the platforms that have them. */
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/* Bytes committed at a time where reserved pages must be committed first. */
+#define ARENA_COMMIT_STEP ((size_t)1 << 20)
+
+bool create_level_arena(LevelArena *arena, size_t capacity, const bool huge_pages)
+{
+    if (!arena) {
+        fprintf(stderr, "Cannot create arena into null pointer.\n");
+        return 1;
+    }
+    if (!capacity)
+        capacity = LEVEL_ARENA_DEFAULT_CAPACITY;
+
+    *arena = (LevelArena) { 0 };
+
+#if !defined(_WIN32)
+    void *addr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    /*
+     * No MAP_NORESERVE here: without a reservation, touching a page the
+     * huge page pool cannot back raises SIGBUS instead of failing now.
+     */
+    if (huge_pages) {
+        const size_t huge_capacity = (capacity + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        addr = mmap(NULL, huge_capacity, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            capacity = huge_capacity;
+            arena->huge_pages = true;
+        }
+    }
+#endif
+
+    if (addr == MAP_FAILED) {
+        addr = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+#if defined(MADV_HUGEPAGE)
+        if (addr != MAP_FAILED && huge_pages)
+            arena->huge_pages = !madvise(addr, capacity, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (addr != MAP_FAILED) {
+        arena->base = (uint8_t *)addr;
+        arena->capacity = capacity;
+        arena->committed = capacity;
+        arena->mapped = true;
+        return 0;
+    }
+#else
+    (void)huge_pages;
+
+    /* Reserve address space only; arena_alloc() commits pages as it goes. */
+    void *addr = VirtualAlloc(NULL, capacity, MEM_RESERVE, PAGE_NOACCESS);
+    if (addr) {
+        arena->base = (uint8_t *)addr;
+        arena->capacity = capacity;
+        arena->mapped = true;
+        return 0;
+    }
+#endif
+
+    arena->base = (uint8_t *)malloc(capacity);
+    if (!arena->base) {
+        fprintf(stderr, "Failed to allocate memory for level arena.\n");
+        return 1;
+    }
+    arena->capacity = capacity;
+    arena->committed = capacity;
+
+    return 0;
+}
+
+void destroy_level_arena(LevelArena *arena)
+{
+    if (!arena || !arena->base)
+        return;
+
+#if !defined(_WIN32)
+    if (arena->mapped)
+        munmap(arena->base, arena->capacity);
+    else
+#else
+    if (arena->mapped)
+        VirtualFree(arena->base, 0, MEM_RELEASE);
+    else
+#endif
+        free(arena->base);
+
+    *arena = (LevelArena) { 0 };
+}
+
+#if defined(_WIN32)
+/**
+ * Commit the reserved pages of an arena up to at least end bytes.
+ */
+static bool commit_arena(LevelArena *arena, const size_t end)
+{
+    size_t committed = atomic_load(&arena->committed);
+    if (end <= committed)
+        return 0;
+
+    size_t target = (end + ARENA_COMMIT_STEP - 1) & ~(ARENA_COMMIT_STEP - 1);
+    if (target > arena->capacity)
+        target = arena->capacity;
+
+    /* Committing pages twice is harmless, so racing threads need no lock. */
+    if (!VirtualAlloc(arena->base + committed, target - committed, MEM_COMMIT, PAGE_READWRITE))
+        return 1;
+    while (committed < target && !atomic_compare_exchange_weak(&arena->committed, &committed, target))
+        ;
+
+    return 0;
+}
+#endif
+
+void *arena_alloc(LevelArena *arena, const size_t sz, const size_t align)
+{
+    size_t used = atomic_load_explicit(&arena->used, memory_order_relaxed);
+    size_t start;
+
+    do {
+        /* Align the address, not the offset: heap blocks are only 16-aligned. */
+        const uintptr_t at = (uintptr_t)(arena->base + used);
+        start = used + (((at + align - 1) & ~(uintptr_t)(align - 1)) - at);
+
+        if (start > arena->capacity || sz > arena->capacity - start)
+            return NULL;
+#if defined(_WIN32)
+        if (commit_arena(arena, start + sz))
+            return NULL;
+#endif
+    } while (!atomic_compare_exchange_weak_explicit(&arena->used, &used, start + sz,
+                memory_order_relaxed, memory_order_relaxed));
+
+    return arena->base + start;
+}
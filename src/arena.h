@@ -0,0 +1,90 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Address space reserved for a level when no capacity is given. */
+#define LEVEL_ARENA_DEFAULT_CAPACITY ((size_t)256 << 20)
+
+/**
+ * A single block holding everything that lives as long as a level: decoded
+ * map lumps, BSP nodes, blockmap and derived tables. Allocation bumps a
+ * pointer, and the whole level is released at once.
+ */
+typedef struct {
+    uint8_t *base;
+
+    /**
+     * Bytes reserved. Reserved pages only take memory once they are
+     * touched.
+     */
+    size_t capacity;
+
+    /**
+     * Bytes handed out so far, bumped atomically so that the tables of a
+     * level can be built on several threads at once.
+     */
+    _Atomic size_t used;
+
+    /**
+     * Bytes usable without committing more pages: all of them, except on
+     * Windows where reserved pages are committed by arena_alloc().
+     */
+    _Atomic size_t committed;
+
+    /**
+     * Whether base is a mapping (or a heap block), and whether it is
+     * backed by huge pages.
+     */
+    bool mapped, huge_pages;
+} LevelArena;
+
+/**
+ * @brief Reserve the block of a level arena.
+ *
+ * With huge_pages, explicit huge pages are tried first, then transparent
+ * huge pages; the arena silently falls back to normal pages. Explicit
+ * huge pages are reserved for the whole capacity up front, so size it for
+ * the level rather than using the default.
+ *
+ * @param arena Pointer where to store the arena.
+ * @param capacity Number of bytes to reserve, or 0 for the default.
+ * @param huge_pages Whether to back the arena with huge pages.
+ * @returns 0 on success, 1 on failure.
+ */
+bool create_level_arena(LevelArena *arena, size_t capacity, bool huge_pages);
+
+/**
+ * @brief Release the block of a level arena.
+ *
+ * @param arena Pointer to the arena.
+ */
+void destroy_level_arena(LevelArena *arena);
+
+/**
+ * @brief Forget every allocation, so the arena can hold the next level.
+ *
+ * @param arena Pointer to the arena.
+ */
+static inline void reset_level_arena(LevelArena *arena)
+{
+    arena->used = 0;
+}
+
+/**
+ * @brief Allocate from a level arena.
+ *
+ * Safe to call from several threads at once, but not together with
+ * reset_level_arena().
+ *
+ * @param arena Pointer to the arena.
+ * @param sz Number of bytes.
+ * @param align Alignment, a power of two.
+ * @returns Pointer to the memory, or NULL if the arena is full.
+ */
+void *arena_alloc(LevelArena *arena, size_t sz, size_t align);
+
+#endif // ARENA_H
@@ -0,0 +1,74 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Bitsets are arrays of 64-bit words; bit i is bit i % 64 of word i / 64.
+ */
+
+static inline size_t bitset_words(const size_t n_bits)
+{
+    return (n_bits + 63) / 64;
+}
+
+static inline bool bitset_test(const uint64_t *bits, const size_t i)
+{
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void bitset_set(uint64_t *bits, const size_t i)
+{
+    bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+static inline void bitset_clear(uint64_t *bits, const size_t i)
+{
+    bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+/**
+ * @brief Get the index of the lowest set bit of a non-zero word.
+ */
+static inline unsigned lowest_bit(const uint64_t word)
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(word);
+#else
+    unsigned i = 0;
+    while (!((word >> i) & 1))
+        i++;
+    return i;
+#endif
+}
+
+/**
+ * @brief Find the first set bit at or after i.
+ *
+ * @param bits The bitset.
+ * @param n_bits Number of bits in the bitset.
+ * @param i Index to start from.
+ * @returns Index of the bit, or n_bits if there is none.
+ */
+static inline size_t bitset_next(const uint64_t *bits, const size_t n_bits, const size_t i)
+{
+    if (i >= n_bits)
+        return n_bits;
+
+    size_t word = i / 64;
+    uint64_t w = bits[word] & (~(uint64_t)0 << (i % 64));
+    const size_t n_words = bitset_words(n_bits);
+
+    while (!w) {
+        if (++word == n_words)
+            return n_bits;
+        w = bits[word];
+    }
+
+    const size_t next = word * 64 + lowest_bit(w);
+    return next < n_bits ? next : n_bits;
+}
+
+#endif // BITSET_H
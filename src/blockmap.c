@@ -0,0 +1,384 @@
+#include "blockmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Header of the BLOCKMAP lump: origin, columns and rows. */
+#define BLOCKMAP_HEADER_SIZE 8
+
+/* End of a cell list in the BLOCKMAP lump. */
+#define BLOCKMAP_LIST_END 0xFFFF
+
+/*
+ * Segments walked through the grid must stay within this distance of the
+ * origin, so that the DDA's cross-multiplied distances fit in 64 bits.
+ */
+#define BLOCKMAP_MAX_COORD ((int64_t)1 << 24)
+
+/* Called for each cell a segment passes through; returns 1 to stop. */
+typedef bool (*CellFn)(uint32_t cell, void *ctx);
+
+static inline int64_t floor_div(const int64_t a, const int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * Walk the cells of the grid that a segment passes through, in order.
+ *
+ * Moving from a cell to the next, the segment crosses either a vertical
+ * or a horizontal cell boundary: whichever it reaches first, comparing
+ * the distances to both as fractions of the segment with integers only.
+ */
+static bool walk_cells(const Blockmap *blockmap, const int32_t x0, const int32_t y0,
+        const int32_t x1, const int32_t y1, CellFn fn, void *ctx)
+{
+    const int64_t lx0 = (int64_t)x0 - blockmap->origin_x;
+    const int64_t ly0 = (int64_t)y0 - blockmap->origin_y;
+    const int64_t lx1 = (int64_t)x1 - blockmap->origin_x;
+    const int64_t ly1 = (int64_t)y1 - blockmap->origin_y;
+
+    if (lx0 <= -BLOCKMAP_MAX_COORD || lx0 >= BLOCKMAP_MAX_COORD || ly0 <= -BLOCKMAP_MAX_COORD || ly0 >= BLOCKMAP_MAX_COORD
+            || lx1 <= -BLOCKMAP_MAX_COORD || lx1 >= BLOCKMAP_MAX_COORD || ly1 <= -BLOCKMAP_MAX_COORD || ly1 >= BLOCKMAP_MAX_COORD)
+        return 0;
+
+    const int64_t dx = lx1 - lx0, dy = ly1 - ly0;
+    const int64_t abs_dx = dx < 0 ? -dx : dx, abs_dy = dy < 0 ? -dy : dy;
+    const int64_t step_x = dx < 0 ? -1 : 1, step_y = dy < 0 ? -1 : 1;
+    const int64_t end_x = floor_div(lx1, BLOCKMAP_CELL), end_y = floor_div(ly1, BLOCKMAP_CELL);
+    int64_t cx = floor_div(lx0, BLOCKMAP_CELL), cy = floor_div(ly0, BLOCKMAP_CELL);
+
+    /* Distance from the start to the next boundary crossed along each axis. */
+    int64_t next_x = dx < 0 ? lx0 - cx * BLOCKMAP_CELL : (cx + 1) * BLOCKMAP_CELL - lx0;
+    int64_t next_y = dy < 0 ? ly0 - cy * BLOCKMAP_CELL : (cy + 1) * BLOCKMAP_CELL - ly0;
+    bool entered = false;
+
+    for (;;) {
+        if (cx >= 0 && cy >= 0 && cx < blockmap->width && cy < blockmap->height) {
+            entered = true;
+            if (fn((uint32_t)(cy * blockmap->width + cx), ctx))
+                return 1;
+        } else if (entered) {
+            /* The grid is convex: once left, it is not entered again. */
+            break;
+        }
+
+        if (cx == end_x && cy == end_y)
+            break;
+        /* next_x / abs_dx <= next_y / abs_dy, with ties crossing x first. */
+        if (cy == end_y || (cx != end_x && next_x * abs_dy <= next_y * abs_dx)) {
+            cx += step_x;
+            next_x += BLOCKMAP_CELL;
+        } else {
+            cy += step_y;
+            next_y += BLOCKMAP_CELL;
+        }
+    }
+
+    return 0;
+}
+
+static bool count_cell_line(const uint32_t cell, void *ctx)
+{
+    ((Blockmap *)ctx)->offsets[cell + 1]++;
+    return 0;
+}
+
+/* Line being added to the cells it passes through. */
+typedef struct {
+    const Blockmap *blockmap;
+    uint32_t line;
+} CellLine;
+
+static bool add_cell_line(const uint32_t cell, void *ctx)
+{
+    const CellLine *cell_line = (const CellLine *)ctx;
+
+    cell_line->blockmap->lines[cell_line->blockmap->offsets[cell]++] = cell_line->line;
+    return 0;
+}
+
+/**
+ * Turn per-cell counts stored at offsets[cell + 1] into offsets.
+ */
+static void sum_offsets(uint32_t *offsets, const uint32_t n_cells)
+{
+    offsets[0] = 0;
+    for (uint32_t i = 0; i < n_cells; i++)
+        offsets[i + 1] += offsets[i];
+}
+
+/**
+ * After filling the lists with offsets[cell]++, each offset points at the
+ * start of the next cell: shift them back.
+ */
+static void restore_offsets(uint32_t *offsets, const uint32_t n_cells)
+{
+    memmove(offsets + 1, offsets, n_cells * sizeof(uint32_t));
+    offsets[0] = 0;
+}
+
+bool build_blockmap(const Map *map, LevelArena *arena, Blockmap *blockmap)
+{
+    int32_t min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+
+    if (map->n_vertices) {
+        min_x = max_x = map->xs[0];
+        min_y = max_y = map->ys[0];
+    }
+    for (uint32_t i = 1; i < map->n_vertices; i++) {
+        min_x = map->xs[i] < min_x ? map->xs[i] : min_x;
+        max_x = map->xs[i] > max_x ? map->xs[i] : max_x;
+        min_y = map->ys[i] < min_y ? map->ys[i] : min_y;
+        max_y = map->ys[i] > max_y ? map->ys[i] : max_y;
+    }
+
+    *blockmap = (Blockmap) { 0 };
+    blockmap->origin_x = min_x;
+    blockmap->origin_y = min_y;
+    blockmap->width = (uint32_t)(((int64_t)max_x - min_x) / BLOCKMAP_CELL + 1);
+    blockmap->height = (uint32_t)(((int64_t)max_y - min_y) / BLOCKMAP_CELL + 1);
+
+    const uint32_t n_cells = blockmap->width * blockmap->height;
+    blockmap->offsets = (uint32_t *)arena_alloc(arena, ((size_t)n_cells + 1) * sizeof(uint32_t), 64);
+    if (!blockmap->offsets) {
+        fprintf(stderr, "Level arena too small for blockmap.\n");
+        return 1;
+    }
+    memset(blockmap->offsets, 0, ((size_t)n_cells + 1) * sizeof(uint32_t));
+
+    /* Count the lines of each cell, then fill the lists. */
+    for (uint32_t i = 0; i < map->n_linedefs; i++) {
+        walk_cells(blockmap, map->xs[map->starts[i]], map->ys[map->starts[i]],
+                map->xs[map->ends[i]], map->ys[map->ends[i]], count_cell_line, blockmap);
+    }
+    sum_offsets(blockmap->offsets, n_cells);
+
+    blockmap->n_lines = blockmap->offsets[n_cells];
+    blockmap->lines = (uint32_t *)arena_alloc(arena, (blockmap->n_lines ? blockmap->n_lines : 1) * sizeof(uint32_t), 64);
+    if (!blockmap->lines) {
+        fprintf(stderr, "Level arena too small for blockmap.\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < map->n_linedefs; i++) {
+        CellLine ctx = { blockmap, i };
+        walk_cells(blockmap, map->xs[map->starts[i]], map->ys[map->starts[i]],
+                map->xs[map->ends[i]], map->ys[map->ends[i]], add_cell_line, &ctx);
+    }
+    restore_offsets(blockmap->offsets, n_cells);
+
+    return 0;
+}
+
+/**
+ * Find the list of a cell in the BLOCKMAP lump, past the leading 0 that
+ * every list starts with, and count its lines. Fails if the list runs
+ * past the lump or references missing linedefs.
+ */
+static bool find_lump_list(const WadSpan lump, const uint32_t cell, const uint32_t n_linedefs,
+        size_t *start, uint32_t *n_lines)
+{
+    size_t p = (size_t)span_u16(lump, BLOCKMAP_HEADER_SIZE + 2 * (size_t)cell) * 2;
+
+    if (p + 2 <= lump.sz && span_u16(lump, p) == 0)
+        p += 2;
+    *start = p;
+    *n_lines = 0;
+
+    for (; p + 2 <= lump.sz; p += 2) {
+        const uint16_t line = span_u16(lump, p);
+        if (line == BLOCKMAP_LIST_END)
+            return 0;
+        if (line >= n_linedefs)
+            return 1;
+        (*n_lines)++;
+    }
+
+    return 1;
+}
+
+/* Order linedef numbers for qsort(). */
+static int compare_lines(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Check that a BLOCKMAP lump can be used as is.
+ */
+static bool check_blockmap_lump(const WadSpan lump, const uint32_t n_linedefs)
+{
+    if (lump.sz < BLOCKMAP_HEADER_SIZE)
+        return 1;
+
+    const size_t n_cells = (size_t)span_u16(lump, 4) * span_u16(lump, 6);
+
+    /* Offsets are 16-bit word counts: past 64K words they may have wrapped. */
+    if (!n_cells || lump.sz > 0x10000 * 2 || BLOCKMAP_HEADER_SIZE + 2 * n_cells > lump.sz)
+        return 1;
+
+    for (uint32_t cell = 0; cell < n_cells; cell++) {
+        size_t start;
+        uint32_t n_lines;
+        if ((size_t)span_u16(lump, BLOCKMAP_HEADER_SIZE + 2 * (size_t)cell) * 2 < BLOCKMAP_HEADER_SIZE + 2 * n_cells
+                || find_lump_list(lump, cell, n_linedefs, &start, &n_lines))
+            return 1;
+    }
+
+    return 0;
+}
+
+bool load_blockmap(const WadSpan lump, const Map *map, LevelArena *arena, Blockmap *blockmap)
+{
+    if (check_blockmap_lump(lump, map->n_linedefs))
+        return build_blockmap(map, arena, blockmap);
+
+    *blockmap = (Blockmap) { 0 };
+    blockmap->origin_x = span_i16(lump, 0);
+    blockmap->origin_y = span_i16(lump, 2);
+    blockmap->width = span_u16(lump, 4);
+    blockmap->height = span_u16(lump, 6);
+
+    const uint32_t n_cells = blockmap->width * blockmap->height;
+    blockmap->offsets = (uint32_t *)arena_alloc(arena, ((size_t)n_cells + 1) * sizeof(uint32_t), 64);
+    if (!blockmap->offsets) {
+        fprintf(stderr, "Level arena too small for blockmap.\n");
+        return 1;
+    }
+
+    size_t start;
+    uint32_t n_lines;
+    for (uint32_t cell = 0; cell < n_cells; cell++) {
+        find_lump_list(lump, cell, map->n_linedefs, &start, &n_lines);
+        blockmap->offsets[cell + 1] = n_lines;
+    }
+    sum_offsets(blockmap->offsets, n_cells);
+
+    blockmap->n_lines = blockmap->offsets[n_cells];
+    blockmap->lines = (uint32_t *)arena_alloc(arena, (blockmap->n_lines ? blockmap->n_lines : 1) * sizeof(uint32_t), 64);
+    if (!blockmap->lines) {
+        fprintf(stderr, "Level arena too small for blockmap.\n");
+        return 1;
+    }
+
+    for (uint32_t cell = 0; cell < n_cells; cell++) {
+        find_lump_list(lump, cell, map->n_linedefs, &start, &n_lines);
+        uint32_t *lines = &blockmap->lines[blockmap->offsets[cell]];
+        for (uint32_t i = 0; i < n_lines; i++)
+            lines[i] = span_u16(lump, start + 2 * (size_t)i);
+        /* Node builders do not all write lists in order. */
+        if (n_lines > 1)
+            qsort(lines, n_lines, sizeof(uint32_t), compare_lines);
+    }
+
+    return 0;
+}
+
+bool init_blockmap_visit(BlockmapVisit *visit, const Map *map, LevelArena *arena)
+{
+    visit->n_linedefs = map->n_linedefs;
+    visit->stamp = 0;
+    visit->stamps = (uint32_t *)arena_alloc(arena, (map->n_linedefs ? map->n_linedefs : 1) * sizeof(uint32_t), 64);
+    if (!visit->stamps) {
+        fprintf(stderr, "Level arena too small for blockmap query.\n");
+        return 1;
+    }
+    memset(visit->stamps, 0, (map->n_linedefs ? map->n_linedefs : 1) * sizeof(uint32_t));
+
+    return 0;
+}
+
+/**
+ * Start a new query, so every line can be reported again.
+ */
+static void next_visit(BlockmapVisit *visit)
+{
+    if (!++visit->stamp) {
+        memset(visit->stamps, 0, visit->n_linedefs * sizeof(uint32_t));
+        visit->stamp = 1;
+    }
+}
+
+/* A query in progress, over several cells. */
+typedef struct {
+    const Blockmap *blockmap;
+    BlockmapVisit *visit;
+    BlockmapLineFn fn;
+    void *ctx;
+} LineQuery;
+
+/**
+ * Report the lines of a cell not reported yet by the query.
+ */
+static bool visit_cell_lines(const uint32_t cell, void *arg)
+{
+    const LineQuery *query = (const LineQuery *)arg;
+    uint32_t n_lines;
+    const uint32_t *lines = blockmap_cell_lines(query->blockmap, cell, &n_lines);
+
+    for (uint32_t i = 0; i < n_lines; i++) {
+        if (query->visit->stamps[lines[i]] == query->visit->stamp)
+            continue;
+        query->visit->stamps[lines[i]] = query->visit->stamp;
+        if (query->fn(lines[i], query->ctx))
+            return 1;
+    }
+
+    return 0;
+}
+
+bool blockmap_point_lines(const Blockmap *blockmap, const int32_t x, const int32_t y, BlockmapLineFn fn, void *ctx)
+{
+    uint32_t cell;
+    if (blockmap_cell(blockmap, x, y, &cell))
+        return 0;
+
+    /* A single cell lists each line once. */
+    uint32_t n_lines;
+    const uint32_t *lines = blockmap_cell_lines(blockmap, cell, &n_lines);
+    for (uint32_t i = 0; i < n_lines; i++) {
+        if (fn(lines[i], ctx))
+            return 1;
+    }
+
+    return 0;
+}
+
+bool blockmap_box_lines(const Blockmap *blockmap, BlockmapVisit *visit, const int32_t left, const int32_t bottom,
+        const int32_t right, const int32_t top, BlockmapLineFn fn, void *ctx)
+{
+    int64_t x0 = floor_div((int64_t)left - blockmap->origin_x, BLOCKMAP_CELL);
+    int64_t y0 = floor_div((int64_t)bottom - blockmap->origin_y, BLOCKMAP_CELL);
+    int64_t x1 = floor_div((int64_t)right - blockmap->origin_x, BLOCKMAP_CELL);
+    int64_t y1 = floor_div((int64_t)top - blockmap->origin_y, BLOCKMAP_CELL);
+
+    /* Clip the box to the grid. */
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 >= blockmap->width ? (int64_t)blockmap->width - 1 : x1;
+    y1 = y1 >= blockmap->height ? (int64_t)blockmap->height - 1 : y1;
+
+    LineQuery query = { blockmap, visit, fn, ctx };
+    next_visit(visit);
+
+    for (int64_t y = y0; y <= y1; y++) {
+        for (int64_t x = x0; x <= x1; x++) {
+            if (visit_cell_lines((uint32_t)(y * blockmap->width + x), &query))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+bool blockmap_ray_lines(const Blockmap *blockmap, BlockmapVisit *visit, const int32_t x0, const int32_t y0,
+        const int32_t x1, const int32_t y1, BlockmapLineFn fn, void *ctx)
+{
+    LineQuery query = { blockmap, visit, fn, ctx };
+    next_visit(visit);
+
+    return walk_cells(blockmap, x0, y0, x1, y1, visit_cell_lines, &query);
+}
@@ -0,0 +1,173 @@
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wad.h"
+#include "map.h"
+#include "arena.h"
+
+/* Side of a blockmap cell, in map units. */
+#define BLOCKMAP_CELL 128
+
+/**
+ * Grid of BLOCKMAP_CELL square cells over a map, listing the linedefs that
+ * cross each cell. Cell (x, y) is number y * width + x; its lines are
+ * lines[offsets[cell]] to lines[offsets[cell + 1]], in increasing order.
+ * Everything lives in the level arena.
+ */
+typedef struct {
+    int32_t origin_x, origin_y; // bottom left corner of cell 0
+    uint32_t width, height; // in cells
+
+    uint32_t *offsets; // width * height + 1 entries
+    uint32_t *lines;
+    uint32_t n_lines;
+} Blockmap;
+
+/**
+ * Per-thread scratch for queries that visit several cells, so that lines
+ * crossing more than one cell are reported once. Stamps are bumped
+ * instead of cleared between queries.
+ */
+typedef struct {
+    uint32_t *stamps; // last query that reported each linedef
+    uint32_t stamp;
+    uint32_t n_linedefs;
+} BlockmapVisit;
+
+/**
+ * Called once for each line found by a query.
+ *
+ * @param line Index of the linedef.
+ * @param ctx Pointer given to the query.
+ * @returns 0 to continue, 1 to stop the query.
+ */
+typedef bool (*BlockmapLineFn)(uint32_t line, void *ctx);
+
+/**
+ * @brief Load the BLOCKMAP lump of a map.
+ *
+ * The blockmap is rebuilt from the linedefs if the lump is missing,
+ * references missing linedefs, or is too large for its 16-bit offsets.
+ *
+ * @param lump Span over the lump, possibly empty.
+ * @param map Pointer to the loaded map.
+ * @param arena Pointer to the arena of the level.
+ * @param blockmap Pointer where to store the blockmap.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_blockmap(WadSpan lump, const Map *map, LevelArena *arena, Blockmap *blockmap);
+
+/**
+ * @brief Build a blockmap from the linedefs of a map.
+ *
+ * The grid covers every vertex. Each line is listed in every cell its
+ * segment passes through.
+ *
+ * @param map Pointer to the loaded map.
+ * @param arena Pointer to the arena of the level.
+ * @param blockmap Pointer where to store the blockmap.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_blockmap(const Map *map, LevelArena *arena, Blockmap *blockmap);
+
+/**
+ * @brief Allocate the scratch of a thread for blockmap queries.
+ *
+ * @param visit Pointer where to store the scratch.
+ * @param map Pointer to the loaded map.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool init_blockmap_visit(BlockmapVisit *visit, const Map *map, LevelArena *arena);
+
+/**
+ * @brief Find the cell holding a point.
+ *
+ * @param blockmap Pointer to the blockmap.
+ * @param x X coordinate of the point.
+ * @param y Y coordinate of the point.
+ * @param cell Pointer where to store the cell number.
+ * @returns 0 on success, 1 if the point is outside the grid.
+ */
+static inline bool blockmap_cell(const Blockmap *blockmap, const int32_t x, const int32_t y, uint32_t *cell)
+{
+    const int64_t dx = (int64_t)x - blockmap->origin_x;
+    const int64_t dy = (int64_t)y - blockmap->origin_y;
+
+    if (dx < 0 || dy < 0 || dx >= (int64_t)blockmap->width * BLOCKMAP_CELL
+            || dy >= (int64_t)blockmap->height * BLOCKMAP_CELL)
+        return 1;
+
+    *cell = (uint32_t)(dy / BLOCKMAP_CELL) * blockmap->width + (uint32_t)(dx / BLOCKMAP_CELL);
+    return 0;
+}
+
+/**
+ * @brief Get the lines of a cell.
+ *
+ * @param blockmap Pointer to the blockmap.
+ * @param cell The cell number.
+ * @param n_lines Pointer where to store the number of lines.
+ * @returns Pointer to the first line of the cell.
+ */
+static inline const uint32_t *blockmap_cell_lines(const Blockmap *blockmap, const uint32_t cell, uint32_t *n_lines)
+{
+    *n_lines = blockmap->offsets[cell + 1] - blockmap->offsets[cell];
+    return blockmap->lines + blockmap->offsets[cell];
+}
+
+/**
+ * @brief Visit the lines of the cell holding a point.
+ *
+ * @param blockmap Pointer to the blockmap.
+ * @param x X coordinate of the point.
+ * @param y Y coordinate of the point.
+ * @param fn Function called for each line.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the query, 0 otherwise.
+ */
+bool blockmap_point_lines(const Blockmap *blockmap, int32_t x, int32_t y, BlockmapLineFn fn, void *ctx);
+
+/**
+ * @brief Visit the lines of every cell overlapping a box, once each.
+ *
+ * @param blockmap Pointer to the blockmap.
+ * @param visit Pointer to the scratch of the calling thread.
+ * @param left Smallest x of the box.
+ * @param bottom Smallest y of the box.
+ * @param right Largest x of the box.
+ * @param top Largest y of the box.
+ * @param fn Function called for each line.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the query, 0 otherwise.
+ */
+bool blockmap_box_lines(const Blockmap *blockmap, BlockmapVisit *visit, int32_t left, int32_t bottom,
+        int32_t right, int32_t top, BlockmapLineFn fn, void *ctx);
+
+/**
+ * @brief Visit the lines of every cell a segment passes through, once
+ *        each, cell by cell from its start to its end.
+ *
+ * Cells are walked with an exact integer grid DDA; when the segment goes
+ * through a cell corner, one of the two side cells is visited as well.
+ * Lines are reported in blockmap order within a cell, so a hitscan sorts
+ * the hits of each cell itself and can stop at the first cell with a hit.
+ * Segments reaching 2^24 units or more from the origin visit nothing.
+ *
+ * @param blockmap Pointer to the blockmap.
+ * @param visit Pointer to the scratch of the calling thread.
+ * @param x0 X coordinate of the start.
+ * @param y0 Y coordinate of the start.
+ * @param x1 X coordinate of the end.
+ * @param y1 Y coordinate of the end.
+ * @param fn Function called for each line.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the query, 0 otherwise.
+ */
+bool blockmap_ray_lines(const Blockmap *blockmap, BlockmapVisit *visit, int32_t x0, int32_t y0,
+        int32_t x1, int32_t y1, BlockmapLineFn fn, void *ctx);
+
+#endif // BLOCKMAP_H
@@ -0,0 +1,725 @@
+#include "bsp-builder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#define BSP_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define BSP_PI 3.14159265358979323846
+
+/* Side of a partition line a seg goes to. */
+enum {
+    SIDE_FRONT,
+    SIDE_BACK,
+    SIDE_SPLIT,
+};
+
+/**
+ * Classify a seg from the cross products of its ends with the partition
+ * line (negative on the right), and whether it runs the same way.
+ */
+static inline int classify(const int64_t a, const int64_t b, const bool same_way)
+{
+    if (a <= 0 && b <= 0)
+        return a || b || same_way ? SIDE_FRONT : SIDE_BACK;
+    if (a >= 0 && b >= 0)
+        return SIDE_BACK;
+    return SIDE_SPLIT;
+}
+
+static inline int64_t cross(const int64_t x, const int64_t y, const int64_t dx, const int64_t dy,
+        const int64_t px, const int64_t py)
+{
+    return dx * (py - y) - dy * (px - x);
+}
+
+#if defined(BSP_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+/**
+ * Four segs per iteration, in doubles.
+ */
+__attribute__((target("avx2")))
+static uint32_t count_sides_avx2(const int32_t *x0s, const int32_t *y0s, const int32_t *x1s, const int32_t *y1s,
+        const uint32_t n, const int32_t x, const int32_t y, const int32_t dx, const int32_t dy, uint32_t counts[3])
+{
+    const __m256d px = _mm256_set1_pd(x), py = _mm256_set1_pd(y);
+    const __m256d pdx = _mm256_set1_pd(dx), pdy = _mm256_set1_pd(dy);
+    const __m256d zero = _mm256_setzero_pd();
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m256d x0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&x0s[i]));
+        const __m256d y0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&y0s[i]));
+        const __m256d x1 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&x1s[i]));
+        const __m256d y1 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&y1s[i]));
+        const __m256d a = _mm256_sub_pd(_mm256_mul_pd(pdx, _mm256_sub_pd(y0, py)),
+                _mm256_mul_pd(pdy, _mm256_sub_pd(x0, px)));
+        const __m256d b = _mm256_sub_pd(_mm256_mul_pd(pdx, _mm256_sub_pd(y1, py)),
+                _mm256_mul_pd(pdy, _mm256_sub_pd(x1, px)));
+        const __m256d dot = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x1, x0), pdx),
+                _mm256_mul_pd(_mm256_sub_pd(y1, y0), pdy));
+
+        const __m256d le = _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_LE_OQ), _mm256_cmp_pd(b, zero, _CMP_LE_OQ));
+        const __m256d ge = _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_GE_OQ), _mm256_cmp_pd(b, zero, _CMP_GE_OQ));
+        const __m256d on = _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_EQ_OQ), _mm256_cmp_pd(b, zero, _CMP_EQ_OQ));
+        const __m256d against = _mm256_andnot_pd(_mm256_cmp_pd(dot, zero, _CMP_GT_OQ), on);
+        const __m256d front = _mm256_andnot_pd(against, le);
+        const int n_front = __builtin_popcount(_mm256_movemask_pd(front));
+        const int n_back = __builtin_popcount(_mm256_movemask_pd(_mm256_andnot_pd(front, ge)));
+
+        counts[SIDE_FRONT] += n_front;
+        counts[SIDE_BACK] += n_back;
+        counts[SIDE_SPLIT] += 4 - n_front - n_back;
+    }
+
+    return i;
+}
+#endif
+
+SideCounts count_sides(const int32_t *x0s, const int32_t *y0s, const int32_t *x1s, const int32_t *y1s,
+        const uint32_t n, const int32_t x, const int32_t y, const int32_t dx, const int32_t dy)
+{
+    uint32_t counts[3] = { 0 };
+    uint32_t i = 0;
+
+#if defined(BSP_SIMD)
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        i = count_sides_avx2(x0s, y0s, x1s, y1s, n, x, y, dx, dy, counts);
+#endif
+    /*
+     * Products of 17-bit deltas fit in a double's mantissa, so the signs
+     * of the cross and dot products are exact, as with int64.
+     */
+    const __m128d px = _mm_set1_pd(x), py = _mm_set1_pd(y);
+    const __m128d pdx = _mm_set1_pd(dx), pdy = _mm_set1_pd(dy);
+    const __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        const __m128d x0 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&x0s[i]));
+        const __m128d y0 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&y0s[i]));
+        const __m128d x1 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&x1s[i]));
+        const __m128d y1 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&y1s[i]));
+        const __m128d a = _mm_sub_pd(_mm_mul_pd(pdx, _mm_sub_pd(y0, py)), _mm_mul_pd(pdy, _mm_sub_pd(x0, px)));
+        const __m128d b = _mm_sub_pd(_mm_mul_pd(pdx, _mm_sub_pd(y1, py)), _mm_mul_pd(pdy, _mm_sub_pd(x1, px)));
+        const __m128d dot = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(x1, x0), pdx), _mm_mul_pd(_mm_sub_pd(y1, y0), pdy));
+
+        const __m128d le = _mm_and_pd(_mm_cmple_pd(a, zero), _mm_cmple_pd(b, zero));
+        const __m128d ge = _mm_and_pd(_mm_cmpge_pd(a, zero), _mm_cmpge_pd(b, zero));
+        const __m128d on = _mm_and_pd(_mm_cmpeq_pd(a, zero), _mm_cmpeq_pd(b, zero));
+        const __m128d front = _mm_andnot_pd(_mm_andnot_pd(_mm_cmpgt_pd(dot, zero), on), le);
+        const int n_front = __builtin_popcount(_mm_movemask_pd(front));
+        const int n_back = __builtin_popcount(_mm_movemask_pd(_mm_andnot_pd(front, ge)));
+
+        counts[SIDE_FRONT] += n_front;
+        counts[SIDE_BACK] += n_back;
+        counts[SIDE_SPLIT] += 2 - n_front - n_back;
+    }
+#endif
+
+    for (; i < n; i++) {
+        const int64_t a = cross(x, y, dx, dy, x0s[i], y0s[i]);
+        const int64_t b = cross(x, y, dx, dy, x1s[i], y1s[i]);
+        const bool same_way = ((int64_t)x1s[i] - x0s[i]) * dx + ((int64_t)y1s[i] - y0s[i]) * dy > 0;
+        counts[classify(a, b, same_way)]++;
+    }
+
+    return (SideCounts) { counts[SIDE_FRONT], counts[SIDE_BACK], counts[SIDE_SPLIT] };
+}
+
+/* State of the build of a subtree. */
+typedef struct {
+    const Map *map;
+    ThreadPool *pool;
+
+    /**
+     * Fragment of the tree the subtree goes to, its indices counted from
+     * the start of the fragment except for vertices, which start at base.
+     * Vertices below base belong to the map or to the enclosing subtrees.
+     */
+    BspTree *tree;
+    uint32_t base;
+
+    /* Number of segs tried as splitters per set, or 0 for all. */
+    uint32_t n_candidates;
+
+    /**
+     * Ends of the segs of the node being split, one array per field.
+     */
+    int32_t *x0s, *y0s, *x1s, *y1s;
+} Builder;
+
+/**
+ * Make room for need elements of sz bytes in a growable array.
+ */
+static bool reserve(void **array, uint32_t *max, const uint32_t need, const size_t sz)
+{
+    if (need <= *max)
+        return 0;
+
+    uint32_t n = *max ? *max : 64;
+    while (n < need)
+        n *= 2;
+
+    void *p = realloc(*array, (size_t)n * sz);
+    if (!p) {
+        fprintf(stderr, "Failed to allocate memory for BSP.\n");
+        return 1;
+    }
+    *array = p;
+    *max = n;
+
+    return 0;
+}
+
+static bool add_vertex(Builder *builder, const int32_t x, const int32_t y, uint32_t *vertex)
+{
+    BspTree *tree = builder->tree;
+
+    if (tree->n_vertices == tree->max_vertices) {
+        const uint32_t max = tree->max_vertices ? tree->max_vertices * 2 : 64;
+        int32_t *xs = (int32_t *)realloc(tree->xs, max * sizeof(int32_t));
+        if (xs)
+            tree->xs = xs;
+        int32_t *ys = (int32_t *)realloc(tree->ys, max * sizeof(int32_t));
+        if (ys)
+            tree->ys = ys;
+        if (!xs || !ys) {
+            fprintf(stderr, "Failed to allocate memory for BSP.\n");
+            return 1;
+        }
+        tree->max_vertices = max;
+    }
+
+    tree->xs[tree->n_vertices] = x;
+    tree->ys[tree->n_vertices] = y;
+    *vertex = builder->base + tree->n_vertices++;
+    return 0;
+}
+
+static void seg_box(const BspSeg *segs, const uint32_t n, int16_t box[4])
+{
+    int32_t top = segs[0].y0, bottom = segs[0].y0, left = segs[0].x0, right = segs[0].x0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t xs[2] = { segs[i].x0, segs[i].x1 }, ys[2] = { segs[i].y0, segs[i].y1 };
+        for (size_t j = 0; j < 2; j++) {
+            top = ys[j] > top ? ys[j] : top;
+            bottom = ys[j] < bottom ? ys[j] : bottom;
+            left = xs[j] < left ? xs[j] : left;
+            right = xs[j] > right ? xs[j] : right;
+        }
+    }
+
+    box[0] = (int16_t)top;
+    box[1] = (int16_t)bottom;
+    box[2] = (int16_t)left;
+    box[3] = (int16_t)right;
+}
+
+static inline bool fits_node(const int64_t v)
+{
+    return v >= INT16_MIN && v <= INT16_MAX;
+}
+
+/**
+ * Set the line of a node to that of a seg, with its direction divided by
+ * its largest divisor to fit long lines. Fails if it still doesn't fit.
+ */
+static bool node_line(const BspSeg *seg, Node *node)
+{
+    int64_t dx = (int64_t)seg->x1 - seg->x0, dy = (int64_t)seg->y1 - seg->y0;
+    int64_t a = dx < 0 ? -dx : dx, b = dy < 0 ? -dy : dy;
+
+    while (b) {
+        const int64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    if (!a)
+        return 1;
+    dx /= a;
+    dy /= a;
+
+    if (!fits_node(seg->x0) || !fits_node(seg->y0) || !fits_node(dx) || !fits_node(dy))
+        return 1;
+
+    node->x = (int16_t)seg->x0;
+    node->y = (int16_t)seg->y0;
+    node->dx = (int16_t)dx;
+    node->dy = (int16_t)dy;
+    return 0;
+}
+
+/**
+ * Whether a line is one of those that failed to split a set.
+ */
+static bool is_banned(const Node *node, const Node *bans, const uint32_t n_bans)
+{
+    for (uint32_t i = 0; i < n_bans; i++) {
+        if (!cross(bans[i].x, bans[i].y, bans[i].dx, bans[i].dy, node->x, node->y)
+                && (int32_t)bans[i].dx * node->dy == (int32_t)bans[i].dy * node->dx)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Pick the line that best splits a set among n_tries segs spread evenly
+ * over it, or fail if none has segs behind it or crossing it.
+ */
+static bool try_splitters(Builder *builder, const BspSeg *segs, const uint32_t n, const uint32_t n_tries,
+        const Node *bans, const uint32_t n_bans, Node *best, SideCounts *best_counts)
+{
+    uint64_t best_cost = UINT64_MAX;
+
+    for (uint32_t j = 0; j < n_tries; j++) {
+        const uint32_t i = (uint32_t)((uint64_t)j * n / n_tries);
+        const BspSeg *seg = &segs[i];
+        Node node;
+
+        /* The back of a two-sided line follows its front: same line. */
+        if (i && seg->linedef == segs[i - 1].linedef && seg->x0 == segs[i - 1].x1 && seg->y0 == segs[i - 1].y1
+                && seg->x1 == segs[i - 1].x0 && seg->y1 == segs[i - 1].y0)
+            continue;
+        if (node_line(seg, &node) || is_banned(&node, bans, n_bans))
+            continue;
+
+        const SideCounts counts = count_sides(builder->x0s, builder->y0s, builder->x1s, builder->y1s, n,
+                node.x, node.y, node.dx, node.dy);
+        if (!counts.back && !counts.split)
+            continue;
+
+        const uint64_t balance = counts.front > counts.back ? counts.front - counts.back : counts.back - counts.front;
+        const uint64_t cost = balance + (uint64_t)BSP_SPLIT_COST * counts.split;
+        if (cost < best_cost) {
+            best_cost = cost;
+            *best = node;
+            *best_counts = counts;
+        }
+    }
+
+    return best_cost != UINT64_MAX;
+}
+
+/**
+ * Pick the line of the seg that best splits a set, or fail if the set is
+ * convex: no line has segs behind it or crossing it. A set whose sampled
+ * candidates all fail gets every seg tried, so leaves stay convex.
+ */
+static bool pick_splitter(Builder *builder, const BspSeg *segs, const uint32_t n, const Node *bans,
+        const uint32_t n_bans, Node *best, SideCounts *best_counts)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        builder->x0s[i] = segs[i].x0;
+        builder->y0s[i] = segs[i].y0;
+        builder->x1s[i] = segs[i].x1;
+        builder->y1s[i] = segs[i].y1;
+    }
+
+    if (builder->n_candidates && builder->n_candidates < n
+            && try_splitters(builder, segs, n, builder->n_candidates, bans, n_bans, best, best_counts))
+        return 1;
+    return try_splitters(builder, segs, n, n, bans, n_bans, best, best_counts);
+}
+
+/**
+ * Put a seg on the side of the partition it lies on, splitting it at the
+ * nearest integer point if it crosses the line. A split that rounds to
+ * an end of the seg leaves the seg whole.
+ */
+static bool split_seg(Builder *builder, const BspSeg *seg, const Node *node,
+        BspSeg *front, uint32_t *n_front, BspSeg *back, uint32_t *n_back)
+{
+    const int64_t a = cross(node->x, node->y, node->dx, node->dy, seg->x0, seg->y0);
+    const int64_t b = cross(node->x, node->y, node->dx, node->dy, seg->x1, seg->y1);
+    const bool same_way = ((int64_t)seg->x1 - seg->x0) * node->dx + ((int64_t)seg->y1 - seg->y0) * node->dy > 0;
+    const int side = classify(a, b, same_way);
+
+    if (side != SIDE_SPLIT) {
+        if (side == SIDE_FRONT)
+            front[(*n_front)++] = *seg;
+        else
+            back[(*n_back)++] = *seg;
+        return 0;
+    }
+
+    const double t = (double)a / (double)(a - b);
+    const int32_t x = seg->x0 + (int32_t)llround(t * ((double)seg->x1 - seg->x0));
+    const int32_t y = seg->y0 + (int32_t)llround(t * ((double)seg->y1 - seg->y0));
+
+    if (x == seg->x0 && y == seg->y0) {
+        if (b < 0)
+            front[(*n_front)++] = *seg;
+        else
+            back[(*n_back)++] = *seg;
+        return 0;
+    }
+    if (x == seg->x1 && y == seg->y1) {
+        if (a < 0)
+            front[(*n_front)++] = *seg;
+        else
+            back[(*n_back)++] = *seg;
+        return 0;
+    }
+
+    uint32_t vertex;
+    if (add_vertex(builder, x, y, &vertex))
+        return 1;
+
+    BspSeg head = *seg, tail = *seg;
+    head.x1 = tail.x0 = x;
+    head.y1 = tail.y0 = y;
+    head.end_vertex = tail.start_vertex = vertex;
+    tail.offset = (int16_t)(seg->offset + lround(hypot((double)x - seg->x0, (double)y - seg->y0)));
+
+    if (a < 0) {
+        front[(*n_front)++] = head;
+        back[(*n_back)++] = tail;
+    } else {
+        back[(*n_back)++] = head;
+        front[(*n_front)++] = tail;
+    }
+
+    return 0;
+}
+
+static bool emit_subsector(Builder *builder, const BspSeg *segs, const uint32_t n, uint32_t *child)
+{
+    BspTree *tree = builder->tree;
+
+    if (reserve((void **)&tree->segs, &tree->max_segs, tree->n_segs + n, sizeof(Seg))
+            || reserve((void **)&tree->subsectors, &tree->max_subsectors, tree->n_subsectors + 1, sizeof(Subsector)))
+        return 1;
+
+    tree->subsectors[tree->n_subsectors] = (Subsector) { tree->n_segs, n, segs[0].sector };
+    for (uint32_t i = 0; i < n; i++) {
+        tree->segs[tree->n_segs++] = (Seg) {
+            segs[i].start_vertex, segs[i].end_vertex, segs[i].linedef, segs[i].sidedef, segs[i].sector,
+            segs[i].angle, segs[i].offset, segs[i].direction,
+        };
+    }
+    *child = NODE_SUBSECTOR | tree->n_subsectors++;
+
+    return 0;
+}
+
+static bool build_subtree(Builder *builder, const BspSeg *segs, uint32_t n, uint32_t depth,
+        uint32_t *child, int16_t box[4]);
+
+/* Build of a subtree on the pool. */
+typedef struct {
+    Builder builder;
+    const BspSeg *segs;
+    uint32_t n, depth;
+    uint32_t child;
+    int16_t *box;
+    bool ret;
+} SubtreeJob;
+
+static void run_subtree_job(void *arg)
+{
+    SubtreeJob *job = (SubtreeJob *)arg;
+    Builder *builder = &job->builder;
+
+    builder->x0s = (int32_t *)malloc(job->n * sizeof(int32_t));
+    builder->y0s = (int32_t *)malloc(job->n * sizeof(int32_t));
+    builder->x1s = (int32_t *)malloc(job->n * sizeof(int32_t));
+    builder->y1s = (int32_t *)malloc(job->n * sizeof(int32_t));
+    if (!builder->x0s || !builder->y0s || !builder->x1s || !builder->y1s)
+        fprintf(stderr, "Failed to allocate memory for BSP.\n");
+    else
+        job->ret = build_subtree(builder, job->segs, job->n, job->depth, &job->child, job->box);
+
+    free(builder->y1s);
+    free(builder->x1s);
+    free(builder->y0s);
+    free(builder->x0s);
+}
+
+/**
+ * Append a fragment built from the vertex base to the tree of a builder,
+ * renumbering what it holds, and translate the child number of its root.
+ */
+static bool merge_fragment(Builder *builder, const BspTree *fragment, const uint32_t base, uint32_t *child)
+{
+    BspTree *tree = builder->tree;
+    const uint32_t shift = builder->base + tree->n_vertices - base;
+
+    if (reserve((void **)&tree->segs, &tree->max_segs, tree->n_segs + fragment->n_segs, sizeof(Seg))
+            || reserve((void **)&tree->subsectors, &tree->max_subsectors,
+                tree->n_subsectors + fragment->n_subsectors, sizeof(Subsector))
+            || reserve((void **)&tree->nodes, &tree->max_nodes, tree->n_nodes + fragment->n_nodes, sizeof(Node)))
+        return 1;
+    for (uint32_t i = 0; i < fragment->n_vertices; i++) {
+        uint32_t vertex;
+        if (add_vertex(builder, fragment->xs[i], fragment->ys[i], &vertex))
+            return 1;
+    }
+
+    for (uint32_t i = 0; i < fragment->n_segs; i++) {
+        Seg seg = fragment->segs[i];
+        seg.start_vertex += seg.start_vertex >= base ? shift : 0;
+        seg.end_vertex += seg.end_vertex >= base ? shift : 0;
+        tree->segs[tree->n_segs + i] = seg;
+    }
+    for (uint32_t i = 0; i < fragment->n_subsectors; i++) {
+        Subsector subsector = fragment->subsectors[i];
+        subsector.first_seg += tree->n_segs;
+        tree->subsectors[tree->n_subsectors + i] = subsector;
+    }
+    for (uint32_t i = 0; i < fragment->n_nodes; i++) {
+        Node node = fragment->nodes[i];
+        node.right_child += node.right_child & NODE_SUBSECTOR ? tree->n_subsectors : tree->n_nodes;
+        node.left_child += node.left_child & NODE_SUBSECTOR ? tree->n_subsectors : tree->n_nodes;
+        tree->nodes[tree->n_nodes + i] = node;
+    }
+
+    *child += *child & NODE_SUBSECTOR ? tree->n_subsectors : tree->n_nodes;
+    tree->n_segs += fragment->n_segs;
+    tree->n_subsectors += fragment->n_subsectors;
+    tree->n_nodes += fragment->n_nodes;
+
+    return 0;
+}
+
+/**
+ * Build the front and back subtrees of a node on the pool, each into a
+ * fragment, and merge them in the order of a serial build.
+ */
+static bool fork_subtrees(Builder *builder, const BspSeg *front, const uint32_t n_front,
+        const BspSeg *back, const uint32_t n_back, const uint32_t depth,
+        uint32_t *right, uint32_t *left, int16_t right_box[4], int16_t left_box[4])
+{
+    /* Both fragments number their vertices from the end of this one. */
+    const uint32_t base = builder->base + builder->tree->n_vertices;
+    BspTree fragments[2] = { 0 };
+    SubtreeJob jobs[2] = {
+        { { builder->map, builder->pool, &fragments[0], base, builder->n_candidates, NULL, NULL, NULL, NULL },
+            front, n_front, depth, 0, right_box, 1 },
+        { { builder->map, builder->pool, &fragments[1], base, builder->n_candidates, NULL, NULL, NULL, NULL },
+            back, n_back, depth, 0, left_box, 1 },
+    };
+    const Task tasks[2] = { { run_subtree_job, &jobs[0] }, { run_subtree_job, &jobs[1] } };
+
+    bool ret = run_tasks(builder->pool, tasks, 2) || jobs[0].ret || jobs[1].ret
+        || merge_fragment(builder, &fragments[0], base, &jobs[0].child)
+        || merge_fragment(builder, &fragments[1], base, &jobs[1].child);
+    *right = jobs[0].child;
+    *left = jobs[1].child;
+
+    free_bsp(&fragments[1]);
+    free_bsp(&fragments[0]);
+    return ret;
+}
+
+/**
+ * Build the subtree of a set of segs, storing its child number and its
+ * bounding box.
+ */
+static bool build_subtree(Builder *builder, const BspSeg *segs, const uint32_t n, const uint32_t depth,
+        uint32_t *child, int16_t box[4])
+{
+    const uint32_t n_vertices = builder->tree->n_vertices;
+    BspSeg *front = NULL, *back = NULL;
+    Node *bans = NULL;
+    uint32_t n_front, n_back, n_bans = 0, max_bans = 0, right, left;
+    Node node = { 0 };
+    SideCounts counts;
+    bool ret = 1;
+
+    seg_box(segs, n, box);
+    for (;;) {
+        if (depth >= BSP_MAX_DEPTH || !pick_splitter(builder, segs, n, bans, n_bans, &node, &counts)) {
+            ret = emit_subsector(builder, segs, n, child);
+            goto exit_subtree;
+        }
+
+        free(back);
+        free(front);
+        front = (BspSeg *)malloc((counts.front + counts.split) * sizeof(BspSeg));
+        back = (BspSeg *)malloc((counts.back + counts.split) * sizeof(BspSeg));
+        if (!front || !back) {
+            fprintf(stderr, "Failed to allocate memory for BSP.\n");
+            goto exit_subtree;
+        }
+
+        n_front = n_back = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (split_seg(builder, &segs[i], &node, front, &n_front, back, &n_back))
+                goto exit_subtree;
+        }
+        if (n_front && n_back)
+            break;
+
+        /* Every split rounded to the front: try another line. */
+        if (reserve((void **)&bans, &max_bans, n_bans + 1, sizeof(Node)))
+            goto exit_subtree;
+        bans[n_bans++] = node;
+        builder->tree->n_vertices = n_vertices;
+    }
+
+    if (builder->pool && n >= BSP_PARALLEL_SEGS) {
+        if (fork_subtrees(builder, front, n_front, back, n_back, depth + 1, &right, &left, node.right_box, node.left_box))
+            goto exit_subtree;
+    } else if (build_subtree(builder, front, n_front, depth + 1, &right, node.right_box)
+            || build_subtree(builder, back, n_back, depth + 1, &left, node.left_box)) {
+        goto exit_subtree;
+    }
+
+    BspTree *tree = builder->tree;
+    if (reserve((void **)&tree->nodes, &tree->max_nodes, tree->n_nodes + 1, sizeof(Node)))
+        goto exit_subtree;
+    node.right_child = right;
+    node.left_child = left;
+    tree->nodes[tree->n_nodes] = node;
+    *child = tree->n_nodes++;
+    ret = 0;
+
+exit_subtree:
+    free(bans);
+    free(back);
+    free(front);
+    return ret;
+}
+
+static int16_t seg_angle(const int32_t dx, const int32_t dy)
+{
+    return (int16_t)(uint16_t)((uint32_t)lround(atan2(dy, dx) * 32768.0 / BSP_PI) & 0xFFFF);
+}
+
+/**
+ * Make a seg for each side of every linedef, skipping zero-length ones.
+ */
+static BspSeg *make_segs(const Map *map, uint32_t *n_segs)
+{
+    BspSeg *segs = (BspSeg *)malloc(((size_t)map->n_linedefs * 2 + 1) * sizeof(BspSeg));
+    uint32_t n = 0;
+
+    if (!segs) {
+        fprintf(stderr, "Failed to allocate memory for BSP.\n");
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < map->n_linedefs; i++) {
+        const uint32_t start = map->starts[i], end = map->ends[i];
+        const int32_t x0 = map->xs[start], y0 = map->ys[start], x1 = map->xs[end], y1 = map->ys[end];
+
+        if (x0 == x1 && y0 == y1)
+            continue;
+
+        const uint16_t right = map->right_side_defs[i];
+        segs[n++] = (BspSeg) { x0, y0, x1, y1, start, end, i, right, map->front_sectors[i],
+            seg_angle(x1 - x0, y1 - y0), 0, 0 };
+
+        const uint16_t left = map->left_side_defs[i];
+        if (left != MAP_NO_SIDEDEF) {
+            segs[n++] = (BspSeg) { x1, y1, x0, y0, end, start, i, left, map->back_sectors[i],
+                seg_angle(x0 - x1, y0 - y1), 0, 1 };
+        }
+    }
+
+    *n_segs = n;
+    return segs;
+}
+
+bool build_bsp(const Map *map, ThreadPool *pool, const uint32_t n_candidates, BspTree *tree)
+{
+    Builder builder = { map, pool, tree, 0, n_candidates, NULL, NULL, NULL, NULL };
+    uint32_t n_segs, root;
+    int16_t box[4];
+    bool ret = 1;
+
+    *tree = (BspTree) { 0 };
+    BspSeg *segs = make_segs(map, &n_segs);
+    if (!segs)
+        return 1;
+    if (!n_segs) {
+        fprintf(stderr, "Cannot build BSP of a map without lines.\n");
+        goto exit_build;
+    }
+
+    /* Vertices of the map come first. */
+    tree->max_vertices = map->n_vertices + 1;
+    tree->xs = (int32_t *)malloc(tree->max_vertices * sizeof(int32_t));
+    tree->ys = (int32_t *)malloc(tree->max_vertices * sizeof(int32_t));
+    builder.x0s = (int32_t *)malloc(n_segs * sizeof(int32_t));
+    builder.y0s = (int32_t *)malloc(n_segs * sizeof(int32_t));
+    builder.x1s = (int32_t *)malloc(n_segs * sizeof(int32_t));
+    builder.y1s = (int32_t *)malloc(n_segs * sizeof(int32_t));
+    if (!tree->xs || !tree->ys || !builder.x0s || !builder.y0s || !builder.x1s || !builder.y1s) {
+        fprintf(stderr, "Failed to allocate memory for BSP.\n");
+        goto exit_build;
+    }
+    memcpy(tree->xs, map->xs, map->n_vertices * sizeof(int32_t));
+    memcpy(tree->ys, map->ys, map->n_vertices * sizeof(int32_t));
+    tree->n_vertices = map->n_vertices;
+
+    /* A child gets at most the segs of its parent, splits included. */
+    ret = build_subtree(&builder, segs, n_segs, 0, &root, box);
+
+exit_build:
+    free(builder.y1s);
+    free(builder.x1s);
+    free(builder.y0s);
+    free(builder.x0s);
+    free(segs);
+    if (ret)
+        free_bsp(tree);
+    return ret;
+}
+
+void free_bsp(BspTree *tree)
+{
+    free(tree->nodes);
+    free(tree->subsectors);
+    free(tree->segs);
+    free(tree->ys);
+    free(tree->xs);
+    *tree = (BspTree) { 0 };
+}
+
+bool build_map_nodes(Map *map, ThreadPool *pool, const uint32_t n_candidates, LevelArena *arena)
+{
+    BspTree tree;
+
+    if (build_bsp(map, pool, n_candidates, &tree))
+        return 1;
+
+    bool ret = 1;
+    int32_t *xs = (int32_t *)arena_alloc(arena, tree.n_vertices * sizeof(int32_t), 64);
+    int32_t *ys = (int32_t *)arena_alloc(arena, tree.n_vertices * sizeof(int32_t), 64);
+    Seg *segs = (Seg *)arena_alloc(arena, tree.n_segs * sizeof(Seg), 64);
+    Subsector *subsectors = (Subsector *)arena_alloc(arena, tree.n_subsectors * sizeof(Subsector), 64);
+    Node *nodes = (Node *)arena_alloc(arena, (tree.n_nodes ? tree.n_nodes : 1) * sizeof(Node), 64);
+    if (!xs || !ys || !segs || !subsectors || !nodes) {
+        fprintf(stderr, "Level arena too small for BSP.\n");
+        goto exit_nodes;
+    }
+
+    memcpy(xs, tree.xs, tree.n_vertices * sizeof(int32_t));
+    memcpy(ys, tree.ys, tree.n_vertices * sizeof(int32_t));
+    memcpy(segs, tree.segs, tree.n_segs * sizeof(Seg));
+    memcpy(subsectors, tree.subsectors, tree.n_subsectors * sizeof(Subsector));
+    memcpy(nodes, tree.nodes, tree.n_nodes * sizeof(Node));
+
+    /* Vertices of the map keep their numbers, so linedefs stay valid. */
+    map->xs = xs;
+    map->ys = ys;
+    map->n_vertices = tree.n_vertices;
+    map->segs = segs;
+    map->n_segs = tree.n_segs;
+    map->subsectors = subsectors;
+    map->n_subsectors = tree.n_subsectors;
+    map->nodes = nodes;
+    map->n_nodes = tree.n_nodes;
+    ret = 0;
+
+exit_nodes:
+    free_bsp(&tree);
+    return ret;
+}
@@ -0,0 +1,118 @@
+#ifndef BSP_BUILDER_H
+#define BSP_BUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "arena.h"
+#include "thread-pool.h"
+
+/* Weight of a split against an unbalanced partition when choosing splitters. */
+#define BSP_SPLIT_COST 8
+
+/* Number of segs below which a subtree is built on one thread. */
+#define BSP_PARALLEL_SEGS 4096
+
+/* Depth past which a non-convex set of segs is left as one subsector. */
+#define BSP_MAX_DEPTH MAP_MAX_NODE_DEPTH
+
+/* Segs, as seen by the builder. */
+typedef struct {
+    int32_t x0, y0, x1, y1;
+    uint32_t start_vertex, end_vertex;
+    uint32_t linedef, sidedef, sector;
+    int16_t angle, offset;
+    uint16_t direction;
+} BspSeg;
+
+/* Number of segs on each side of a partition line. */
+typedef struct {
+    uint32_t front, back, split;
+} SideCounts;
+
+/**
+ * A BSP in the layout of the map lumps, with vertices created by splits
+ * after those of the map. Subsectors are numbered in the order their
+ * leaves are reached, front child first, and nodes after both of their
+ * children, so the root is the last node. A tree with no node has a
+ * single subsector.
+ */
+typedef struct {
+    int32_t *xs, *ys;
+    uint32_t n_vertices, max_vertices;
+    Seg *segs;
+    uint32_t n_segs, max_segs;
+    Subsector *subsectors;
+    uint32_t n_subsectors, max_subsectors;
+    Node *nodes;
+    uint32_t n_nodes, max_nodes;
+} BspTree;
+
+/**
+ * @brief Classify segs against a partition line.
+ *
+ * A seg is in front if it lies on the right of the line, behind if on the
+ * left, and split if its ends are strictly on both sides. Segs on the
+ * line count as front when they run the same way. Products are exact for
+ * 16-bit map coordinates. Uses AVX2 or SSE2 where available.
+ *
+ * @param x0s Array of seg start x coordinates.
+ * @param y0s Array of seg start y coordinates.
+ * @param x1s Array of seg end x coordinates.
+ * @param y1s Array of seg end y coordinates.
+ * @param n Number of segs.
+ * @param x X coordinate of a point of the line.
+ * @param y Y coordinate of a point of the line.
+ * @param dx X direction of the line.
+ * @param dy Y direction of the line.
+ * @returns The number of segs on each side.
+ */
+SideCounts count_sides(const int32_t *x0s, const int32_t *y0s, const int32_t *x1s, const int32_t *y1s,
+        uint32_t n, int32_t x, int32_t y, int32_t dx, int32_t dy);
+
+/**
+ * @brief Build a BSP from the linedefs of a map.
+ *
+ * Each side of every linedef becomes a seg; a splitter is picked among
+ * the lines of the segs to balance both sides against the number of
+ * splits, with ties going to the lowest seg, and segs are split at the
+ * nearest integer point. The result only depends on the map.
+ *
+ * With n_candidates set, only that many segs spread over each set are
+ * tried as splitters, falling back to all of them when none splits it.
+ *
+ * Given a pool, both subtrees of large sets are built as tasks, each into
+ * its own arrays, and appended in the order of a serial build: the tree
+ * is the same for any number of threads.
+ *
+ * @param map Pointer to the loaded map.
+ * @param pool Pointer to the thread pool, or NULL to build serially.
+ * @param n_candidates Number of splitters tried per set, or 0 for all.
+ * @param tree Pointer where to store the tree, in memory owned by it.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_bsp(const Map *map, ThreadPool *pool, uint32_t n_candidates, BspTree *tree);
+
+/**
+ * @brief Free the memory of a tree.
+ *
+ * @param tree Pointer to the tree.
+ */
+void free_bsp(BspTree *tree);
+
+/**
+ * @brief Build the nodes, segs and subsectors of a map that has none, or
+ *        whose geometry changed.
+ *
+ * The map gets the tree and its vertices, copied to the level arena.
+ *
+ * @param map Pointer to the loaded map.
+ * @param pool Pointer to the thread pool, or NULL to build serially.
+ * @param n_candidates Number of splitters tried per set, or 0 for all.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_map_nodes(Map *map, ThreadPool *pool, uint32_t n_candidates, LevelArena *arena);
+
+#endif // BSP_BUILDER_H
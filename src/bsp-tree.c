@@ -1,40 +1,89 @@
 #include "bsp-tree.h"
 
-struct bsp_node* find_node(struct bsp_node *root, const uint16_t data)
+#include <math.h>
+
+uint32_t find_subsector(const Map *map, const float x, const float y)
 {
-    if (!root)
-        return NULL;
+    if (!map->n_subsectors)
+        return MAP_NO_INDEX;
+
+    uint32_t child = bsp_root(map);
 
-    if (root->id == data)
-        return root;
+    while (!is_subsector(child)) {
+        const Node *node = &map->nodes[child];
+        child = node_side(node, x, y) ? node->left_child : node->right_child;
+    }
 
-    if (data <= root->id)
-        return find_node(root->child_left, data);
-    else
-        return find_node(root->child_right, data);
+    return subsector_index(child);
 }
 
-void add_child(struct bsp_node *root, struct bsp_node *child)
+void init_bsp_view(BspView *view, const vector2f_t pos, const vector2f_t dir, const float half_fov)
 {
-    if (child->id <= root->id) {
-        if (!root->child_left)
-            root->child_left = child;
-        else
-            add_child(root->child_left, child);
-    }
-    else {
-        if (!root->child_right)
-            root->child_right = child;
-        else
-            add_child(root->child_right, child);
+    const float c = cosf(half_fov), s = sinf(half_fov);
+
+    view->pos = pos;
+    view->right = (vector2f_t) { dir.x * c + dir.y * s, dir.y * c - dir.x * s };
+    view->left = (vector2f_t) { dir.x * c - dir.y * s, dir.y * c + dir.x * s };
+}
+
+bool box_in_view(const BspView *view, const int16_t box[4])
+{
+    const float top = box[0] - view->pos.y, bottom = box[1] - view->pos.y;
+    const float left = box[2] - view->pos.x, right = box[3] - view->pos.x;
+
+    /*
+     * Both edge tests are linear in the corner, so their largest value
+     * over the box takes one term from each axis.
+     */
+    const float inside_right = fmaxf(view->right.x * top, view->right.x * bottom)
+        + fmaxf(-view->right.y * left, -view->right.y * right);
+    const float inside_left = fmaxf(view->left.y * left, view->left.y * right)
+        + fmaxf(-view->left.x * top, -view->left.x * bottom);
+
+    return inside_right >= 0.0f && inside_left >= 0.0f;
+}
+
+bool walk_bsp_front_to_back(const Map *map, const BspView *view, const BspSubsectorFn fn, void *ctx)
+{
+    uint32_t stack[BSP_STACK_SIZE];
+    size_t depth = 0;
+    uint32_t child = bsp_root(map);
+
+    if (!map->n_subsectors)
+        return 0;
+
+    for (;;) {
+        while (!is_subsector(child)) {
+            const Node *node = &map->nodes[child];
+            const int side = node_side(node, view->pos.x, view->pos.y);
+            const uint32_t near = side ? node->left_child : node->right_child;
+            const uint32_t far = side ? node->right_child : node->left_child;
+
+            if (box_in_view(view, side ? node->right_box : node->left_box))
+                stack[depth++] = far;
+            if (box_in_view(view, side ? node->left_box : node->right_box))
+                child = near;
+            else if (depth)
+                child = stack[--depth];
+            else
+                return 0;
+        }
+
+        if (fn(subsector_index(child), ctx))
+            return 1;
+        if (!depth)
+            return 0;
+        child = stack[--depth];
     }
 }
 
-void print_pre_order_tree_walk(struct bsp_node *root) {
-    if (!root)
+void print_pre_order_tree_walk(const Map *map, const uint32_t child) {
+    if (is_subsector(child)) {
+        printf("s%u\t", subsector_index(child));
         return;
+    }
 
-    printf("%d\t", root->id);
-    print_pre_order_tree_walk(root->child_left);
-    print_pre_order_tree_walk(root->child_right);
+    printf("%u\t", child);
+    print_pre_order_tree_walk(map, map->nodes[child].left_child);
+    print_pre_order_tree_walk(map, map->nodes[child].right_child);
 }
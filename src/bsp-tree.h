@@ -3,57 +3,119 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "vector.h"
+#include "map.h"
 
-struct box {
-    vector2i_t top_left;
-    vector2i_t bottom_right;
-};
-
-struct bsp_node {
-    /**
-     * Unique identifier for the current binary space
-     * partitioning node.
-     */
-    uint16_t id;
-
-    /**
-     * Starting coordinate of the splitter vector.
-     */
-    vector2i_t splitter_start;
-
-    /**
-     * Direction and magnitude of the splitter vector.
-     */
-    vector2i_t splitter_delta;
-
-    /**
-     * Bounding box to the left of the splitter, when
-     * considering the direction following the splitter delta.
-     */
-    struct box left_box;
-
-    /**
-     * Bounding box to the right of the splitter, when
-     * considering the direction following the splitter delta.
-     */
-    struct box right_box;
-
-    /**
-     * Left child of the current binary space partitioning node.
-     */
-    struct bsp_node *child_left;
-
-    /**
-     * Right child of the current binary space partitioning node.
-     */
-    struct bsp_node *child_right;
-};
-
-struct bsp_node* find_node(struct bsp_node *root, const uint16_t id);
-
-void add_child(struct bsp_node *root, struct bsp_node *child);
-
-void print_pre_order_tree_walk(struct bsp_node *root);
-
-#endif /* BSP_TREE_ H */
+/**
+ * Far children a traversal can hold at once: one per level of the tree.
+ * Maps deeper than this are rejected by load_map().
+ */
+#define BSP_STACK_SIZE MAP_MAX_NODE_DEPTH
+
+/**
+ * A camera for traversals: its position and the directions of the right
+ * and left edges of its view cone.
+ */
+typedef struct {
+    vector2f_t pos;
+    vector2f_t right, left;
+} BspView;
+
+/**
+ * Called once for each subsector found by a traversal.
+ *
+ * @param subsector Index of the subsector.
+ * @param ctx Pointer given to the traversal.
+ * @returns 0 to continue, 1 to stop the traversal.
+ */
+typedef bool (*BspSubsectorFn)(uint32_t subsector, void *ctx);
+
+/**
+ * Child number of the root of the tree of a map: its last node, or its
+ * only subsector when it has no node. Only meaningful when the map has at
+ * least one subsector; NODES and SSECTORS may both be missing.
+ */
+static inline uint32_t bsp_root(const Map *map)
+{
+    return map->n_nodes ? map->n_nodes - 1 : NODE_SUBSECTOR;
+}
+
+static inline bool is_subsector(const uint32_t child)
+{
+    return child & NODE_SUBSECTOR;
+}
+
+static inline uint32_t subsector_index(const uint32_t child)
+{
+    return child & ~NODE_SUBSECTOR;
+}
+
+/**
+ * Node with a given number; nodes are numbered by their index in the
+ * array, so this is a lookup rather than a search.
+ */
+static inline const Node* find_node(const Map *map, const uint32_t id)
+{
+    return id < map->n_nodes ? &map->nodes[id] : NULL;
+}
+
+/**
+ * Side of the partition line of a node a point is on. Same rule as the
+ * engine and point_line_sides(): 0 for the right (front), 1 for the left
+ * (back) or on the line.
+ */
+static inline int node_side(const Node *node, const float x, const float y)
+{
+    return (float)node->dx * (y - node->y) - (float)node->dy * (x - node->x) >= 0.0f;
+}
+
+/**
+ * @brief Find the subsector containing a point.
+ *
+ * @param map Pointer to the loaded map.
+ * @param x X coordinate of the point.
+ * @param y Y coordinate of the point.
+ * @returns Index of the subsector, or MAP_NO_INDEX if the map has none.
+ */
+uint32_t find_subsector(const Map *map, float x, float y);
+
+/**
+ * @brief Set up the view cone of a camera.
+ *
+ * @param view Pointer where to store the view.
+ * @param pos Position of the camera, as context.pos.
+ * @param dir Unit direction of the camera, as context.dir.
+ * @param half_fov Half of the field of view in radians, below pi / 2.
+ */
+void init_bsp_view(BspView *view, vector2f_t pos, vector2f_t dir, float half_fov);
+
+/**
+ * @brief Whether a node child box may hold something in the view cone.
+ *
+ * @param view Pointer to the view.
+ * @param box Bounding box of the child: top, bottom, left, right.
+ * @returns 0 if the box is entirely outside one edge of the cone, 1 otherwise.
+ */
+bool box_in_view(const BspView *view, const int16_t box[4]);
+
+/**
+ * @brief Visit the subsectors of a map that may be in view, nearest first.
+ *
+ * At each node the child on the side of the camera comes first. Children
+ * whose box is outside the view cone are skipped along with their whole
+ * subtree. The walk keeps its own stack of far children, so it neither
+ * recurses nor allocates, and fn can stop it once the screen is full.
+ * Nothing is visited on a map without subsectors.
+ *
+ * @param map Pointer to the loaded map.
+ * @param view Pointer to the view.
+ * @param fn Function called for each subsector.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the traversal, 0 otherwise.
+ */
+bool walk_bsp_front_to_back(const Map *map, const BspView *view, BspSubsectorFn fn, void *ctx);
+
+void print_pre_order_tree_walk(const Map *map, uint32_t child);
+
+#endif // BSP_TREE_H
@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+
+#include "level.h"
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* State shared by the tasks of the derive stage. */
+typedef struct {
+    const MapLumps *lumps;
+    LevelArena *arena;
+    ThreadPool *pool;
+    uint32_t thing_capacity;
+    Level *level;
+    LevelLoadStats *stats;
+    atomic_bool failed;
+} DeriveStage;
+
+static void derive_blockmap(void *arg)
+{
+    DeriveStage *stage = (DeriveStage *)arg;
+    const uint64_t start = now_ns();
+
+    if (load_blockmap(stage->lumps->spans[MAP_LUMP_BLOCKMAP], &stage->level->map, stage->arena, &stage->level->blockmap))
+        atomic_store(&stage->failed, true);
+    stage->stats->blockmap_ns = now_ns() - start;
+}
+
+static void derive_line_geometry(void *arg)
+{
+    DeriveStage *stage = (DeriveStage *)arg;
+    const uint64_t start = now_ns();
+
+    if (build_line_geometry(&stage->level->lines, &stage->level->map, stage->arena))
+        atomic_store(&stage->failed, true);
+    stage->stats->line_geometry_ns = now_ns() - start;
+}
+
+static void derive_sector_graph(void *arg)
+{
+    DeriveStage *stage = (DeriveStage *)arg;
+    const uint64_t start = now_ns();
+
+    if (build_sector_graph(&stage->level->sectors, &stage->level->map, stage->arena))
+        atomic_store(&stage->failed, true);
+    stage->stats->sector_graph_ns = now_ns() - start;
+}
+
+/* Needs the sector graph; splits its own work over the pool. */
+static void derive_reject(void *arg)
+{
+    DeriveStage *stage = (DeriveStage *)arg;
+    const uint64_t start = now_ns();
+
+    if (load_reject(stage->lumps->spans[MAP_LUMP_REJECT], &stage->level->map, &stage->level->sectors,
+                stage->pool, stage->arena, &stage->level->reject))
+        atomic_store(&stage->failed, true);
+    stage->stats->reject_ns = now_ns() - start;
+}
+
+/* Needs the blockmap, whose cells the grid uses. */
+static void derive_thing_grid(void *arg)
+{
+    DeriveStage *stage = (DeriveStage *)arg;
+    const uint64_t start = now_ns();
+
+    if (load_thing_grid(&stage->level->things, &stage->level->map, &stage->level->blockmap,
+                stage->thing_capacity, stage->arena))
+        atomic_store(&stage->failed, true);
+    stage->stats->thing_grid_ns = now_ns() - start;
+}
+
+bool load_level(const MapLumps *lumps, LevelArena *arena, ThreadPool *pool, const uint32_t extra_things,
+        Level *level, LevelLoadStats *stats)
+{
+    LevelLoadStats local;
+
+    if (!stats)
+        stats = &local;
+    *stats = (LevelLoadStats) { 0 };
+    *level = (Level) { 0 };
+
+    const uint64_t start = now_ns();
+    if (load_map_parallel(lumps, arena, pool, &level->map, &stats->map))
+        return 1;
+
+    if (level->map.n_things > UINT32_MAX - extra_things) {
+        fprintf(stderr, "Too many things for level.\n");
+        return 1;
+    }
+
+    DeriveStage stage = { lumps, arena, pool, level->map.n_things + extra_things, level, stats, false };
+    const Task first[] = {
+        { derive_sector_graph, &stage },
+        { derive_line_geometry, &stage },
+        { derive_blockmap, &stage },
+    };
+    const Task second[] = {
+        { derive_reject, &stage },
+        { derive_thing_grid, &stage },
+    };
+
+    const uint64_t derive_start = now_ns();
+    if (run_tasks(pool, first, sizeof(first) / sizeof(first[0])) || atomic_load(&stage.failed)
+            || run_tasks(pool, second, sizeof(second) / sizeof(second[0])) || atomic_load(&stage.failed))
+        return 1;
+
+    const uint64_t end = now_ns();
+    stats->derive_ns = end - derive_start;
+    stats->total_ns = end - start;
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "map-lumps.h"
+#include "arena.h"
+#include "thread-pool.h"
+#include "blockmap.h"
+#include "reject.h"
+#include "line-geometry.h"
+#include "sector-graph.h"
+#include "thing-grid.h"
+
+/**
+ * A level: the map and every table derived from it at load, all in the
+ * level arena.
+ */
+typedef struct {
+    Map map;
+    Blockmap blockmap;
+    Reject reject;
+    LineGeometry lines;
+    SectorGraph sectors;
+    ThingGrid things;
+} Level;
+
+/* Wall time of each stage of load_level(), in nanoseconds. */
+typedef struct {
+    MapLoadStats map; // decode and link stages of load_map_parallel()
+    uint64_t derive_ns; // all derived tables, concurrently
+    uint64_t total_ns;
+
+    /**
+     * Time spent building each derived table, on the thread that built it.
+     */
+    uint64_t blockmap_ns, reject_ns, line_geometry_ns, sector_graph_ns, thing_grid_ns;
+} LevelLoadStats;
+
+/**
+ * @brief Load a map and build every table derived from it on a thread pool.
+ *
+ * The map is loaded with load_map_parallel(), then a derive stage builds
+ * the sector graph, line geometry and blockmap concurrently, followed by
+ * the reject table, which needs the sector graph, and the thing grid,
+ * which needs the blockmap. BLOCKMAP and REJECT lumps are used when they
+ * are usable, and built otherwise.
+ *
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @param arena Pointer to the arena of the level.
+ * @param pool Pointer to the thread pool, or NULL to run on this thread.
+ * @param extra_things Room for things spawned on top of those of the map.
+ * @param level Pointer where to store the level.
+ * @param stats Pointer where to store stage timings, or NULL.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_level(const MapLumps *lumps, LevelArena *arena, ThreadPool *pool, uint32_t extra_things,
+        Level *level, LevelLoadStats *stats);
+
+#endif // LEVEL_H
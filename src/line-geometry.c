@@ -0,0 +1,193 @@
+#include "line-geometry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "bitset.h"
+
+#if defined(__SSE2__)
+#define LINE_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Arrays start on cache line boundaries. */
+#define LINE_ALIGN 64
+
+static inline size_t align_up(const size_t x)
+{
+    return (x + LINE_ALIGN - 1) & ~(size_t)(LINE_ALIGN - 1);
+}
+
+/**
+ * Derive the geometry of one line from its vertices.
+ */
+static void compute_line(LineGeometry *geometry, const Map *map, const uint32_t i)
+{
+    const int32_t x0 = map->xs[map->starts[i]], y0 = map->ys[map->starts[i]];
+    const int32_t x1 = map->xs[map->ends[i]], y1 = map->ys[map->ends[i]];
+    const int32_t dx = x1 - x0, dy = y1 - y0;
+    const float length = (float)sqrt((double)dx * dx + (double)dy * dy);
+    const float inv_length = length > 0.0f ? 1.0f / length : 0.0f;
+
+    geometry->xs[i] = x0;
+    geometry->ys[i] = y0;
+    geometry->dxs[i] = dx;
+    geometry->dys[i] = dy;
+    geometry->lengths[i] = length;
+    geometry->inv_lengths[i] = inv_length;
+    geometry->normal_xs[i] = (float)dy * inv_length;
+    geometry->normal_ys[i] = (float)-dx * inv_length;
+    geometry->lefts[i] = x0 < x1 ? x0 : x1;
+    geometry->rights[i] = x0 < x1 ? x1 : x0;
+    geometry->bottoms[i] = y0 < y1 ? y0 : y1;
+    geometry->tops[i] = y0 < y1 ? y1 : y0;
+
+    if (!dx)
+        geometry->slope_types[i] = SLOPE_VERTICAL;
+    else if (!dy)
+        geometry->slope_types[i] = SLOPE_HORIZONTAL;
+    else
+        geometry->slope_types[i] = (dx > 0) == (dy > 0) ? SLOPE_POSITIVE : SLOPE_NEGATIVE;
+}
+
+bool build_line_geometry(LineGeometry *geometry, const Map *map, LevelArena *arena)
+{
+    const uint32_t n = map->n_linedefs;
+    const size_t int_sz = align_up((size_t)n * sizeof(int32_t));
+    const size_t float_sz = align_up((size_t)n * sizeof(float));
+    const size_t type_sz = align_up(n);
+    const size_t dirty_sz = align_up(bitset_words(n) * sizeof(uint64_t));
+    const size_t total = 8 * int_sz + 4 * float_sz + type_sz + dirty_sz;
+
+    uint8_t *p = (uint8_t *)arena_alloc(arena, total ? total : 1, LINE_ALIGN);
+    if (!p) {
+        fprintf(stderr, "Level arena too small for line geometry.\n");
+        return 1;
+    }
+
+    *geometry = (LineGeometry) { 0 };
+    geometry->n_lines = n;
+    geometry->xs = (int32_t *)p;            p += int_sz;
+    geometry->ys = (int32_t *)p;            p += int_sz;
+    geometry->dxs = (int32_t *)p;           p += int_sz;
+    geometry->dys = (int32_t *)p;           p += int_sz;
+    geometry->lefts = (int32_t *)p;         p += int_sz;
+    geometry->bottoms = (int32_t *)p;       p += int_sz;
+    geometry->rights = (int32_t *)p;        p += int_sz;
+    geometry->tops = (int32_t *)p;          p += int_sz;
+    geometry->lengths = (float *)p;         p += float_sz;
+    geometry->inv_lengths = (float *)p;     p += float_sz;
+    geometry->normal_xs = (float *)p;       p += float_sz;
+    geometry->normal_ys = (float *)p;       p += float_sz;
+    geometry->slope_types = p;              p += type_sz;
+    geometry->dirty = (uint64_t *)p;
+
+    memset(geometry->dirty, 0, dirty_sz);
+    for (uint32_t i = 0; i < n; i++)
+        compute_line(geometry, map, i);
+
+    return 0;
+}
+
+void mark_line_dirty(LineGeometry *geometry, const uint32_t line)
+{
+    bitset_set(geometry->dirty, line);
+}
+
+uint32_t update_line_geometry(LineGeometry *geometry, const Map *map)
+{
+    uint32_t n_updated = 0;
+
+    for (size_t word = 0; word < bitset_words(geometry->n_lines); word++) {
+        uint64_t bits = geometry->dirty[word];
+
+        geometry->dirty[word] = 0;
+        for (; bits; bits &= bits - 1, n_updated++)
+            compute_line(geometry, map, (uint32_t)(word * 64 + lowest_bit(bits)));
+    }
+
+    return n_updated;
+}
+
+#if defined(LINE_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+/**
+ * Four lines per iteration, in doubles.
+ */
+__attribute__((target("avx2")))
+static uint32_t point_line_sides_avx2(const LineGeometry *geometry, const uint32_t first, const uint32_t end,
+        const int32_t x, const int32_t y, uint8_t *sides)
+{
+    const __m256d px = _mm256_set1_pd(x), py = _mm256_set1_pd(y);
+    const __m256d zero = _mm256_setzero_pd();
+    uint32_t i = first;
+
+    for (; i + 4 <= end; i += 4) {
+        const __m256d x0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&geometry->xs[i]));
+        const __m256d y0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&geometry->ys[i]));
+        const __m256d dx = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&geometry->dxs[i]));
+        const __m256d dy = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&geometry->dys[i]));
+        const __m256d cross = _mm256_sub_pd(_mm256_mul_pd(dx, _mm256_sub_pd(py, y0)),
+                _mm256_mul_pd(dy, _mm256_sub_pd(px, x0)));
+        const int mask = _mm256_movemask_pd(_mm256_cmp_pd(cross, zero, _CMP_GE_OQ));
+
+        for (uint32_t j = 0; j < 4; j++)
+            sides[i - first + j] = (mask >> j) & 1;
+    }
+
+    return i;
+}
+#endif
+
+void point_line_sides(const LineGeometry *geometry, const uint32_t first, const uint32_t end,
+        const int32_t x, const int32_t y, uint8_t *sides)
+{
+    uint32_t i = first;
+
+#if defined(LINE_SIMD)
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        i = point_line_sides_avx2(geometry, first, end, x, y, sides);
+#endif
+    /*
+     * Deltas of 16-bit map coordinates are at most 17 bits, so products
+     * with any 32-bit offset fit in a double's mantissa: the sign of the
+     * cross product is exact.
+     */
+    const __m128d px = _mm_set1_pd(x), py = _mm_set1_pd(y);
+    for (; i + 2 <= end; i += 2) {
+        const __m128d x0 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&geometry->xs[i]));
+        const __m128d y0 = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&geometry->ys[i]));
+        const __m128d dx = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&geometry->dxs[i]));
+        const __m128d dy = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&geometry->dys[i]));
+        const __m128d cross = _mm_sub_pd(_mm_mul_pd(dx, _mm_sub_pd(py, y0)), _mm_mul_pd(dy, _mm_sub_pd(px, x0)));
+        const int mask = _mm_movemask_pd(_mm_cmpge_pd(cross, _mm_setzero_pd()));
+
+        sides[i - first] = mask & 1;
+        sides[i - first + 1] = (mask >> 1) & 1;
+    }
+#endif
+
+    for (; i < end; i++) {
+        const int64_t cross = (int64_t)geometry->dxs[i] * ((int64_t)y - geometry->ys[i])
+            - (int64_t)geometry->dys[i] * ((int64_t)x - geometry->xs[i]);
+        sides[i - first] = cross >= 0;
+    }
+}
+
+void box_line_sides(const LineGeometry *geometry, const uint32_t first, const uint32_t end,
+        const int32_t left, const int32_t bottom, const int32_t right, const int32_t top, int8_t *sides)
+{
+    for (uint32_t i = first; i < end; i++) {
+        const int64_t x0 = geometry->xs[i], y0 = geometry->ys[i];
+        const int64_t dx = geometry->dxs[i], dy = geometry->dys[i];
+
+        /* The cross product grows with y along +dx and with x along -dy. */
+        const int64_t back_x = dy > 0 ? left : right, back_y = dx > 0 ? top : bottom;
+        const int64_t front_x = dy > 0 ? right : left, front_y = dx > 0 ? bottom : top;
+        const bool back = dx * (back_y - y0) - dy * (back_x - x0) >= 0;
+        const bool front = dx * (front_y - y0) - dy * (front_x - x0) < 0;
+
+        /* Wholly on the back if even the most frontward corner is; -1 if split. */
+        sides[i - first] = (int8_t)(!front ? 1 : back ? -1 : 0);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef LINE_GEOMETRY_H
+#define LINE_GEOMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "arena.h"
+
+/* Orientation of a linedef, as the engine classifies it for box tests. */
+typedef enum {
+    SLOPE_HORIZONTAL,
+    SLOPE_VERTICAL,
+    SLOPE_POSITIVE,
+    SLOPE_NEGATIVE,
+} SlopeType;
+
+/**
+ * Geometry of every linedef, derived from the vertices once per level and
+ * stored one array per field, so that loops over many lines read only the
+ * fields they need and vectorize. Arrays live in the level arena.
+ */
+typedef struct {
+    uint32_t n_lines;
+
+    /**
+     * Start vertex, and end minus start.
+     */
+    int32_t *xs, *ys;
+    int32_t *dxs, *dys;
+
+    /**
+     * Length, and its inverse (0 for zero-length lines).
+     */
+    float *lengths, *inv_lengths;
+
+    /**
+     * Unit normal pointing to the front (right) side.
+     */
+    float *normal_xs, *normal_ys;
+
+    /**
+     * Bounding box.
+     */
+    int32_t *lefts, *bottoms, *rights, *tops;
+
+    uint8_t *slope_types; // SlopeType
+
+    /**
+     * Lines whose vertices moved since the last update_line_geometry(),
+     * one bit per line.
+     */
+    uint64_t *dirty;
+} LineGeometry;
+
+/**
+ * @brief Build the geometry of every linedef of a map.
+ *
+ * @param geometry Pointer where to store the geometry.
+ * @param map Pointer to the loaded map.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_line_geometry(LineGeometry *geometry, const Map *map, LevelArena *arena);
+
+/**
+ * @brief Mark a line whose vertices moved.
+ *
+ * @param geometry Pointer to the geometry.
+ * @param line Index of the linedef.
+ */
+void mark_line_dirty(LineGeometry *geometry, uint32_t line);
+
+/**
+ * @brief Recompute the geometry of every line marked dirty, and clear
+ *        the marks.
+ *
+ * @param geometry Pointer to the geometry.
+ * @param map Pointer to the map, with the moved vertices.
+ * @returns Number of lines recomputed.
+ */
+uint32_t update_line_geometry(LineGeometry *geometry, const Map *map);
+
+/**
+ * @brief Find on which side of lines [first, end) a point lies.
+ *
+ * Same rule as the engine: 0 for the front, 1 for the back or on the
+ * line. Cross products are exact, and computed several lines at a time.
+ *
+ * @param geometry Pointer to the geometry.
+ * @param first First line.
+ * @param end Line after the last one.
+ * @param x X coordinate of the point.
+ * @param y Y coordinate of the point.
+ * @param sides Array where to store the side of each line, indexed from
+ *              first.
+ */
+void point_line_sides(const LineGeometry *geometry, uint32_t first, uint32_t end, int32_t x, int32_t y, uint8_t *sides);
+
+/**
+ * @brief Find on which side of lines [first, end) a box lies.
+ *
+ * Only the two corners furthest from each line on either side are
+ * tested, chosen without branches from the line direction.
+ *
+ * @param geometry Pointer to the geometry.
+ * @param first First line.
+ * @param end Line after the last one.
+ * @param left Smallest x of the box.
+ * @param bottom Smallest y of the box.
+ * @param right Largest x of the box.
+ * @param top Largest y of the box.
+ * @param sides Array where to store 0 (front), 1 (back) or -1 (crossing)
+ *              for each line, indexed from first.
+ */
+void box_line_sides(const LineGeometry *geometry, uint32_t first, uint32_t end,
+        int32_t left, int32_t bottom, int32_t right, int32_t top, int8_t *sides);
+
+#endif // LINE_GEOMETRY_H
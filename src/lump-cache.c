@@ -0,0 +1,271 @@
+#define _DEFAULT_SOURCE /* pread() */
+
+#include "lump-cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * Read exactly sz bytes at the given offset of a file.
+ */
+static bool read_at(const int fd, uint8_t *dst, size_t sz, uint64_t offset)
+{
+#if defined(_WIN32)
+    if (_lseeki64(fd, (__int64)offset, SEEK_SET) == -1)
+        return 1;
+#endif
+
+    while (sz) {
+#if defined(_WIN32)
+        const int n = _read(fd, dst, sz > 0x40000000 ? 0x40000000 : (unsigned)sz);
+#else
+        const ssize_t n = pread(fd, dst, sz, (off_t)offset);
+#endif
+        if (n <= 0)
+            return 1;
+        dst += n;
+        sz -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+
+    return 0;
+}
+
+static void lru_unlink(LumpCache *cache, const uint32_t lump)
+{
+    CachedLump *e = &cache->entries[lump];
+
+    if (e->lru_prev != WAD_NO_LUMP)
+        cache->entries[e->lru_prev].lru_next = e->lru_next;
+    else
+        cache->lru_head = e->lru_next;
+
+    if (e->lru_next != WAD_NO_LUMP)
+        cache->entries[e->lru_next].lru_prev = e->lru_prev;
+    else
+        cache->lru_tail = e->lru_prev;
+
+    e->lru_prev = e->lru_next = WAD_NO_LUMP;
+}
+
+static void lru_push(LumpCache *cache, const uint32_t lump)
+{
+    CachedLump *e = &cache->entries[lump];
+
+    e->lru_prev = cache->lru_tail;
+    e->lru_next = WAD_NO_LUMP;
+    if (cache->lru_tail != WAD_NO_LUMP)
+        cache->entries[cache->lru_tail].lru_next = lump;
+    else
+        cache->lru_head = lump;
+    cache->lru_tail = lump;
+}
+
+/**
+ * Evict unused lumps, least recently used first, until at most target bytes
+ * are resident or every resident lump is in use.
+ */
+static void evict(LumpCache *cache, const size_t target)
+{
+    while (cache->used > target && cache->lru_head != WAD_NO_LUMP) {
+        const uint32_t lump = cache->lru_head;
+        lru_unlink(cache, lump);
+        free(cache->entries[lump].data);
+        cache->entries[lump].data = NULL;
+        cache->used -= cache->index.lumps[lump].lump_size;
+    }
+}
+
+bool open_lump_cache(LumpCache *cache, const char *const *paths, const size_t n_paths, const size_t budget)
+{
+    bool ret = 0;
+
+    /* Check for null pointers. */
+    if (!cache || (!paths && n_paths)) {
+        fprintf(stderr, "Cannot open lump cache from or into null pointer.\n");
+        return 1;
+    }
+
+    *cache = (LumpCache) { 0 };
+    cache->budget = budget;
+    cache->lru_head = cache->lru_tail = WAD_NO_LUMP;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    WadSpan *directories = (WadSpan *)calloc(n_paths ? n_paths : 1, sizeof(WadSpan));
+    size_t *file_sizes = (size_t *)calloc(n_paths ? n_paths : 1, sizeof(size_t));
+    cache->fds = (int *)malloc((n_paths ? n_paths : 1) * sizeof(int));
+    if (!directories || !file_sizes || !cache->fds) {
+        fprintf(stderr, "Failed to allocate memory for lump cache.\n");
+        ret = 1;
+        goto exit_open;
+    }
+
+    /* Read only the header and the directory of each file. */
+    for (size_t i = 0; i < n_paths; i++) {
+        uint8_t header_data[WAD_HEADER_SIZE];
+        const WAD header_wad = { header_data, sizeof(header_data), false };
+        Header header;
+        struct stat st;
+        WadError err;
+
+        const int fd = open(paths[i], O_RDONLY
+#if defined(_WIN32)
+                | O_BINARY
+#endif
+                );
+        if (fd == -1) {
+            perror("Failed to open WAD file");
+            ret = 1;
+            goto exit_open;
+        }
+        cache->fds[cache->n_files++] = fd;
+
+        if (fstat(fd, &st) == -1 || read_at(fd, header_data, sizeof(header_data), 0)) {
+            fprintf(stderr, "Failed to read WAD header: %s\n", paths[i]);
+            ret = 1;
+            goto exit_open;
+        }
+        file_sizes[i] = (size_t)st.st_size;
+
+        if ((err = read_header(&header_wad, &header))) {
+            fprintf(stderr, "Invalid WAD header: %s: %s.\n", paths[i], wad_strerror(err));
+            ret = 1;
+            goto exit_open;
+        }
+
+        const size_t dir_sz = (size_t)header.num_directories * WAD_DIRECTORY_SIZE;
+        if (header.listing_offset > file_sizes[i] || dir_sz > file_sizes[i] - header.listing_offset) {
+            fprintf(stderr, "WAD directory extends beyond WAD size: %s\n", paths[i]);
+            ret = 1;
+            goto exit_open;
+        }
+
+        uint8_t *dir = (uint8_t *)malloc(dir_sz ? dir_sz : 1);
+        directories[i] = (WadSpan) { dir, dir_sz };
+        if (!dir || read_at(fd, dir, dir_sz, header.listing_offset)) {
+            fprintf(stderr, "Failed to read WAD directory: %s\n", paths[i]);
+            ret = 1;
+            goto exit_open;
+        }
+    }
+
+    if (build_wad_index_from_directories(directories, file_sizes, n_paths, &cache->index)) {
+        ret = 1;
+        goto exit_open;
+    }
+
+    cache->entries = (CachedLump *)malloc((cache->index.n_lumps ? cache->index.n_lumps : 1) * sizeof(CachedLump));
+    if (!cache->entries) {
+        fprintf(stderr, "Failed to allocate memory for lump cache.\n");
+        ret = 1;
+        goto exit_open;
+    }
+    for (uint32_t i = 0; i < cache->index.n_lumps; i++)
+        cache->entries[i] = (CachedLump) { NULL, 0, WAD_NO_LUMP, WAD_NO_LUMP };
+
+exit_open:
+    if (directories)
+        for (size_t i = 0; i < n_paths; i++)
+            free((void *)directories[i].data);
+    free(directories);
+    free(file_sizes);
+    if (ret)
+        close_lump_cache(cache);
+    return ret;
+}
+
+void close_lump_cache(LumpCache *cache)
+{
+    if (!cache)
+        return;
+
+    if (cache->entries)
+        for (uint32_t i = 0; i < cache->index.n_lumps; i++)
+            free(cache->entries[i].data);
+    free(cache->entries);
+    free_wad_index(&cache->index);
+
+    for (size_t i = 0; i < cache->n_files; i++)
+        close(cache->fds[i]);
+    free(cache->fds);
+    pthread_mutex_destroy(&cache->lock);
+
+    *cache = (LumpCache) { 0 };
+    cache->lru_head = cache->lru_tail = WAD_NO_LUMP;
+}
+
+bool acquire_lump(LumpCache *cache, const uint32_t lump, WadSpan *span)
+{
+    if (!cache || !span || lump >= cache->index.n_lumps)
+        return 1;
+
+    const WadLump *l = &cache->index.lumps[lump];
+    CachedLump *e = &cache->entries[lump];
+
+    pthread_mutex_lock(&cache->lock);
+    if (!e->data) {
+        /* Make room first, so the budget holds whenever possible. */
+        evict(cache, cache->budget > l->lump_size ? cache->budget - l->lump_size : 0);
+        pthread_mutex_unlock(&cache->lock);
+
+        /* Read without the lock, so other lumps can be served meanwhile. */
+        uint8_t *data = (uint8_t *)malloc(l->lump_size ? l->lump_size : 1);
+        if (!data) {
+            fprintf(stderr, "Failed to allocate memory for lump.\n");
+            return 1;
+        }
+        if (read_at(cache->fds[l->file], data, l->lump_size, l->lump_offset)) {
+            fprintf(stderr, "Failed to read lump %u.\n", lump);
+            free(data);
+            return 1;
+        }
+
+        pthread_mutex_lock(&cache->lock);
+        if (e->data) {
+            /* Another thread read it first. */
+            free(data);
+        } else {
+            e->data = data;
+            cache->used += l->lump_size;
+        }
+    }
+
+    if (!e->refs++ && (e->lru_prev != WAD_NO_LUMP || cache->lru_head == lump))
+        lru_unlink(cache, lump);
+    span->data = e->data;
+    span->sz = l->lump_size;
+    pthread_mutex_unlock(&cache->lock);
+
+    return 0;
+}
+
+void release_lump(LumpCache *cache, const uint32_t lump)
+{
+    if (!cache || lump >= cache->index.n_lumps)
+        return;
+
+    CachedLump *e = &cache->entries[lump];
+
+    pthread_mutex_lock(&cache->lock);
+    if (e->refs && !--e->refs) {
+        lru_push(cache, lump);
+        evict(cache, cache->budget);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void set_lump_cache_budget(LumpCache *cache, const size_t budget)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->budget = budget;
+    evict(cache, budget);
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,119 @@
+#ifndef LUMP_CACHE_H
+#define LUMP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "wad.h"
+#include "wad-index.h"
+
+/* Cache state of one lump. */
+typedef struct {
+    /**
+     * Contents of the lump, or NULL when it is not resident.
+     */
+    uint8_t *data;
+
+    /**
+     * Number of users of the lump. Lumps in use are never evicted.
+     */
+    uint32_t refs;
+
+    /**
+     * Neighbours in the LRU list of resident lumps that are not in use,
+     * or WAD_NO_LUMP.
+     */
+    uint32_t lru_prev, lru_next;
+} CachedLump;
+
+/**
+ * WAD files whose lumps are read on demand, straight from their offsets,
+ * and kept in memory within a byte budget.
+ */
+typedef struct {
+    int *fds;
+    size_t n_files;
+
+    /**
+     * Merged index over every file, built from their directories only.
+     * Lump numbers are indices into index.lumps.
+     */
+    WadIndex index;
+
+    /**
+     * Cache state of every lump, indexed by lump number.
+     */
+    CachedLump *entries;
+
+    /**
+     * Least and most recently released resident lumps not in use.
+     */
+    uint32_t lru_head, lru_tail;
+
+    /**
+     * Bytes of resident lumps, and how many bytes may be resident before
+     * unused lumps get evicted. Lumps in use can take the cache over budget.
+     */
+    size_t used, budget;
+
+    /**
+     * Guards the entries, the LRU list and the byte counts, so lumps can
+     * be acquired from several threads. Lumps are read without holding it.
+     */
+    pthread_mutex_t lock;
+} LumpCache;
+
+/**
+ * @brief Open WAD files for on-demand lump loading.
+ *
+ * Only the header and directory of each file are read. Lumps of later
+ * files override lumps of earlier files with the same name.
+ *
+ * @param cache Pointer where to store the cache.
+ * @param paths The paths to the WAD files, IWAD first.
+ * @param n_paths Number of paths.
+ * @param budget Number of bytes of lumps to keep resident.
+ * @returns 0 on success, 1 on failure.
+ */
+bool open_lump_cache(LumpCache *cache, const char *const *paths, size_t n_paths, size_t budget);
+
+/**
+ * @brief Close the files of a cache and free every lump.
+ *
+ * @param cache Pointer to the cache.
+ */
+void close_lump_cache(LumpCache *cache);
+
+/**
+ * @brief Get the contents of a lump, reading it if it is not resident.
+ *
+ * The lump stays resident until it is released with release_lump().
+ * Safe to call from several threads.
+ *
+ * @param cache Pointer to the cache.
+ * @param lump The lump number.
+ * @param span Pointer where to store the contents.
+ * @returns 0 on success, 1 on failure.
+ */
+bool acquire_lump(LumpCache *cache, uint32_t lump, WadSpan *span);
+
+/**
+ * @brief Release a lump obtained with acquire_lump().
+ *
+ * Once a lump has no users it may be evicted, least recently used first.
+ *
+ * @param cache Pointer to the cache.
+ * @param lump The lump number.
+ */
+void release_lump(LumpCache *cache, uint32_t lump);
+
+/**
+ * @brief Change the byte budget of a cache, evicting lumps if needed.
+ *
+ * @param cache Pointer to the cache.
+ * @param budget Number of bytes of lumps to keep resident.
+ */
+void set_lump_cache_budget(LumpCache *cache, size_t budget);
+
+#endif // LUMP_CACHE_H
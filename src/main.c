@@ -35,6 +35,7 @@ const float MOVE_SPEED = 5.0f * 0.016f;
 const float ROT_SPEED = 3.0f * 0.0026f;
 
 Map map;
+LevelArena level;
 
 static inline float min(const float a, const float b)
 {
@@ -158,15 +159,17 @@ static void draw_player_2d()
 
 static void draw_map_lines_2d()
 {
-    for (uint8_t i = 0; i < map.n_linedefs; ++i) {
-        draw_line_2d(map.vertices[map.linedefs[i].start_vertex], map.vertices[map.linedefs[i].end_vertex], COLOR_MAP_LINES);
+    for (uint32_t i = 0; i < map.n_linedefs; ++i) {
+        const vector2i_t u = { map.xs[map.starts[i]], map.ys[map.starts[i]] };
+        const vector2i_t v = { map.xs[map.ends[i]], map.ys[map.ends[i]] };
+        draw_line_2d(u, v, COLOR_MAP_LINES);
     }
 }
 
 static void draw_map_vertices_2d()
 {
-    for (uint8_t i = 0; i < map.n_vertices; ++i) {
-        context.pixels[SCREEN_WIDTH * map.vertices[i].y + map.vertices[i].x] = COLOR_VERTEX;
+    for (uint32_t i = 0; i < map.n_vertices; ++i) {
+        context.pixels[SCREEN_WIDTH * map.ys[i] + map.xs[i]] = COLOR_VERTEX;
     }
 }
 
@@ -201,21 +204,21 @@ int main(int argc, char *argv[])
     context.dir = norm((vector2f_t) { 1.0f, -0.1f });
     context.delta_time = 0.0f;
 
-    map.n_vertices = 4;
-    map.n_linedefs = 4;
-    map.vertices[0] = (vector2i_t) { 100, 100 };
-    map.vertices[1] = (vector2i_t) { 100, 200 };
-    map.vertices[2] = (vector2i_t) { 200, 200 };
-    map.vertices[3] = (vector2i_t) { 200, 100 };
-    map.linedefs[0] = (Linedef) { 0, 1 };
-    map.linedefs[1] = (Linedef) { 1, 2 };
-    map.linedefs[2] = (Linedef) { 2, 3 };
-    map.linedefs[3] = (Linedef) { 3, 0 };
+    if (create_level_arena(&level, 0, false) || alloc_map(&map, &level, 4, 4))
+        return 1;
+    const int32_t square_xs[4] = { 100, 100, 200, 200 };
+    const int32_t square_ys[4] = { 100, 200, 200, 100 };
+    for (uint32_t i = 0; i < 4; ++i) {
+        map.xs[i] = square_xs[i];
+        map.ys[i] = square_ys[i];
+        map.starts[i] = i;
+        map.ends[i] = (i + 1) % 4;
+    }
 
     WAD data;
     Header header;
     Directory directory;
-    if (load_wad("C:\\Users\\iliya\\Desktop\\bsp-demo\\e1m1.wad", &data))
+    if (load_wad_mapped("C:\\Users\\iliya\\Desktop\\bsp-demo\\e1m1.wad", &data))
         return 1;
     if (load_header(&data, &header))
         return 1;
@@ -226,7 +229,7 @@ int main(int argc, char *argv[])
     printf("%s\n%u\n%u\n",
         directory.lump_name, directory.lump_offset, directory.lump_size);
 
-    free(data.data);
+    unload_wad(&data);
 
     while (!context.quit) {
         context.frame_start = SDL_GetTicks();
@@ -265,6 +268,8 @@ int main(int argc, char *argv[])
         }
     }
 
+    destroy_level_arena(&level);
+
     SDL_DestroyTexture(context.texture);
     SDL_DestroyRenderer(context.renderer);
     SDL_DestroyWindow(context.window);
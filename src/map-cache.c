@@ -0,0 +1,377 @@
+#include "map-cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t record_sizes[MAP_CACHE_SECTIONS] = {
+    sizeof(int32_t), sizeof(int32_t), sizeof(uint32_t), sizeof(uint32_t),
+    sizeof(uint16_t), sizeof(uint16_t), sizeof(uint16_t), sizeof(uint16_t), sizeof(uint16_t),
+    sizeof(uint32_t), sizeof(uint32_t), sizeof(Thing), sizeof(Sidedef), sizeof(Sector), sizeof(uint64_t),
+    sizeof(Node), sizeof(Seg), sizeof(Subsector), sizeof(int16_t), sizeof(uint8_t),
+};
+
+static inline size_t align_up(const size_t x)
+{
+    return (x + MAP_CACHE_ALIGN - 1) & ~(size_t)(MAP_CACHE_ALIGN - 1);
+}
+
+uint64_t hash_map_lumps(const MapLumps *lumps)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        const WadSpan span = lumps->spans[i];
+        size_t j = 0;
+
+        /* Mix in the size too, so moving bytes between lumps changes the hash. */
+        h = (h ^ span.sz) * 0x100000001B3ull;
+        for (; j + 8 <= span.sz; j += 8) {
+            uint64_t w;
+            memcpy(&w, span.data + j, 8);
+            h = (h ^ w) * 0x100000001B3ull;
+            h ^= h >> 29;
+        }
+        for (; j < span.sz; j++)
+            h = (h ^ span.data[j]) * 0x100000001B3ull;
+    }
+
+    return h;
+}
+
+/**
+ * Copy the sidedefs and sectors of a map with their name ids replaced by
+ * indices into a list of the packed names they use.
+ */
+static bool localize_names(const Map *map, Sidedef *sidedefs, Sector *sectors, uint64_t **names, uint32_t *n_names)
+{
+    const uint32_t n_ids = count_names();
+    uint32_t *local = (uint32_t *)malloc((n_ids ? n_ids : 1) * sizeof(uint32_t));
+    *names = (uint64_t *)malloc(((size_t)3 * map->n_sidedefs + 2 * (size_t)map->n_sectors + 1) * sizeof(uint64_t));
+    *n_names = 0;
+    if (!local || !*names) {
+        fprintf(stderr, "Failed to allocate memory for map cache.\n");
+        free(local);
+        return 1;
+    }
+    memset(local, 0xFF, (n_ids ? n_ids : 1) * sizeof(uint32_t));
+
+#define LOCALIZE(id) \
+    do { \
+        if (local[id] == UINT32_MAX) { \
+            (*names)[*n_names] = name_key(id); \
+            local[id] = (*n_names)++; \
+        } \
+        (id) = local[id]; \
+    } while (0)
+
+    for (uint32_t i = 0; i < map->n_sidedefs; i++) {
+        sidedefs[i] = map->sidedefs[i];
+        LOCALIZE(sidedefs[i].upper_texture);
+        LOCALIZE(sidedefs[i].lower_texture);
+        LOCALIZE(sidedefs[i].middle_texture);
+    }
+    for (uint32_t i = 0; i < map->n_sectors; i++) {
+        sectors[i] = map->sectors[i];
+        LOCALIZE(sectors[i].floor_texture);
+        LOCALIZE(sectors[i].ceiling_texture);
+    }
+#undef LOCALIZE
+
+    free(local);
+    return 0;
+}
+
+bool write_map_cache(const char *path, const MapLumps *lumps)
+{
+    MapCacheHeader header = { 0 };
+    LevelArena arena;
+    Map map;
+    bool ret = 0;
+
+    if (create_level_arena(&arena, 0, false))
+        return 1;
+    if (load_map(lumps, &arena, &map)) {
+        destroy_level_arena(&arena);
+        return 1;
+    }
+
+    const WadSpan blockmap_lump = lumps->spans[MAP_LUMP_BLOCKMAP];
+    const WadSpan reject_lump = lumps->spans[MAP_LUMP_REJECT];
+    const uint32_t n_blockmap = (uint32_t)(blockmap_lump.sz / 2);
+
+    int16_t *blockmap = (int16_t *)malloc((n_blockmap ? n_blockmap : 1) * sizeof(int16_t));
+    Sidedef *sidedefs = (Sidedef *)malloc((map.n_sidedefs ? map.n_sidedefs : 1) * sizeof(Sidedef));
+    Sector *sectors = (Sector *)malloc((map.n_sectors ? map.n_sectors : 1) * sizeof(Sector));
+    uint64_t *names = NULL;
+    uint32_t n_names;
+    uint8_t *image = NULL;
+    char *tmp_path = NULL;
+    if (!blockmap || !sidedefs || !sectors) {
+        fprintf(stderr, "Failed to allocate memory for map cache.\n");
+        ret = 1;
+        goto exit_write;
+    }
+    for (uint32_t i = 0; i < n_blockmap; i++)
+        blockmap[i] = span_i16(blockmap_lump, 2 * i);
+    if (localize_names(&map, sidedefs, sectors, &names, &n_names)) {
+        ret = 1;
+        goto exit_write;
+    }
+
+    const struct {
+        const void *data;
+        uint32_t count;
+    } sources[MAP_CACHE_SECTIONS] = {
+        { map.xs, map.n_vertices },
+        { map.ys, map.n_vertices },
+        { map.starts, map.n_linedefs },
+        { map.ends, map.n_linedefs },
+        { map.flags, map.n_linedefs },
+        { map.line_types, map.n_linedefs },
+        { map.sector_tags, map.n_linedefs },
+        { map.right_side_defs, map.n_linedefs },
+        { map.left_side_defs, map.n_linedefs },
+        { map.front_sectors, map.n_linedefs },
+        { map.back_sectors, map.n_linedefs },
+        { map.things, map.n_things },
+        { sidedefs, map.n_sidedefs },
+        { sectors, map.n_sectors },
+        { names, n_names },
+        { map.nodes, map.n_nodes },
+        { map.segs, map.n_segs },
+        { map.subsectors, map.n_subsectors },
+        { blockmap, n_blockmap },
+        { reject_lump.data, (uint32_t)reject_lump.sz },
+    };
+
+    header.magic = MAP_CACHE_MAGIC;
+    header.version = MAP_CACHE_VERSION;
+    header.byte_order = 0x01020304;
+    header.n_sections = MAP_CACHE_SECTIONS;
+    header.source_hash = hash_map_lumps(lumps);
+
+    /* Lay the sections out one after the other. */
+    size_t offset = align_up(sizeof(MapCacheHeader));
+    for (int i = 0; i < MAP_CACHE_SECTIONS; i++) {
+        MapCacheSectionEntry *section = &header.sections[i];
+
+        section->count = sources[i].count;
+        section->record_sz = record_sizes[i];
+        section->sz = (uint64_t)section->count * section->record_sz;
+        section->offset = offset;
+        offset = align_up(offset + section->sz);
+    }
+    header.file_sz = offset;
+
+    image = (uint8_t *)calloc(1, offset);
+    if (!image) {
+        fprintf(stderr, "Failed to allocate memory for map cache.\n");
+        ret = 1;
+        goto exit_write;
+    }
+    memcpy(image, &header, sizeof(header));
+    for (int i = 0; i < MAP_CACHE_SECTIONS; i++)
+        if (header.sections[i].sz)
+            memcpy(image + header.sections[i].offset, sources[i].data, header.sections[i].sz);
+
+    /* Write to a temporary file, then move it into place. */
+    const size_t path_len = strlen(path);
+    tmp_path = (char *)malloc(path_len + 5);
+    if (!tmp_path) {
+        fprintf(stderr, "Failed to allocate memory for map cache.\n");
+        ret = 1;
+        goto exit_write;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+
+    FILE *fptr = fopen(tmp_path, "wb");
+    if (!fptr) {
+        perror("Failed to create map cache file");
+        ret = 1;
+        goto exit_write;
+    }
+    if (fwrite(image, 1, offset, fptr) != offset) {
+        fprintf(stderr, "Failed to write map cache file.\n");
+        fclose(fptr);
+        remove(tmp_path);
+        ret = 1;
+        goto exit_write;
+    }
+    if (fclose(fptr) || rename(tmp_path, path)) {
+        perror("Failed to write map cache file");
+        remove(tmp_path);
+        ret = 1;
+    }
+
+exit_write:
+    free(tmp_path);
+    free(image);
+    free(names);
+    free(sectors);
+    free(sidedefs);
+    free(blockmap);
+    destroy_level_arena(&arena);
+    return ret;
+}
+
+/**
+ * Copy the sidedefs and sectors of a cache file out of the mapping, with
+ * the names they use interned into this process's ids.
+ */
+static bool intern_cached_names(const Sidedef *sidedefs, const Sector *sectors,
+        const uint64_t *names, const uint32_t n_names, MapCache *cache)
+{
+    Map *map = &cache->map;
+    bool ret = 1;
+    uint32_t *ids = (uint32_t *)malloc((n_names ? n_names : 1) * sizeof(uint32_t));
+    cache->named = malloc((size_t)map->n_sidedefs * sizeof(Sidedef) + (size_t)map->n_sectors * sizeof(Sector) + 1);
+    if (!ids || !cache->named) {
+        fprintf(stderr, "Failed to allocate memory for map cache names.\n");
+        goto exit_names;
+    }
+    if (intern_names(names, ids, n_names))
+        goto exit_names;
+
+    map->sidedefs = (Sidedef *)cache->named;
+    map->sectors = (Sector *)(map->sidedefs + map->n_sidedefs);
+
+#define INTERN(id) \
+    do { \
+        if ((id) >= n_names) \
+            goto exit_names; \
+        (id) = ids[id]; \
+    } while (0)
+
+    for (uint32_t i = 0; i < map->n_sidedefs; i++) {
+        map->sidedefs[i] = sidedefs[i];
+        INTERN(map->sidedefs[i].upper_texture);
+        INTERN(map->sidedefs[i].lower_texture);
+        INTERN(map->sidedefs[i].middle_texture);
+    }
+    for (uint32_t i = 0; i < map->n_sectors; i++) {
+        map->sectors[i] = sectors[i];
+        INTERN(map->sectors[i].floor_texture);
+        INTERN(map->sectors[i].ceiling_texture);
+    }
+#undef INTERN
+    ret = 0;
+
+exit_names:
+    free(ids);
+    return ret;
+}
+
+bool open_map_cache(const char *path, const uint64_t source_hash, MapCache *cache)
+{
+    MapCacheHeader header;
+
+    /* A missing file is the normal first-run case, so stay quiet. */
+    FILE *probe = fopen(path, "rb");
+    if (!probe)
+        return 1;
+    fclose(probe);
+
+    if (load_wad_mapped(path, &cache->file))
+        return 1;
+    cache->named = NULL;
+
+    if (cache->file.sz < sizeof(header))
+        goto stale;
+    memcpy(&header, cache->file.data, sizeof(header));
+
+    if (header.magic != MAP_CACHE_MAGIC || header.version != MAP_CACHE_VERSION
+            || header.byte_order != 0x01020304 || header.n_sections != MAP_CACHE_SECTIONS
+            || header.source_hash != source_hash || header.file_sz != cache->file.sz)
+        goto stale;
+
+    /* Check the section table, then the indices in the sections. */
+    for (int i = 0; i < MAP_CACHE_SECTIONS; i++) {
+        const MapCacheSectionEntry *section = &header.sections[i];
+        if (section->record_sz != record_sizes[i]
+                || section->offset % MAP_CACHE_ALIGN
+                || section->sz != (uint64_t)section->count * section->record_sz
+                || section->offset > cache->file.sz
+                || section->sz > cache->file.sz - section->offset)
+            goto stale;
+    }
+    if (header.sections[MAP_CACHE_XS].count != header.sections[MAP_CACHE_YS].count)
+        goto stale;
+    for (int i = MAP_CACHE_ENDS; i <= MAP_CACHE_BACK_SECTORS; i++)
+        if (header.sections[i].count != header.sections[MAP_CACHE_STARTS].count)
+            goto stale;
+
+#define SECTION(type, i) ((type *)(cache->file.data + header.sections[i].offset))
+    Map *map = &cache->map;
+    *map = (Map) { 0 };
+    map->n_vertices = header.sections[MAP_CACHE_XS].count;
+    map->n_linedefs = header.sections[MAP_CACHE_STARTS].count;
+    map->xs = SECTION(int32_t, MAP_CACHE_XS);
+    map->ys = SECTION(int32_t, MAP_CACHE_YS);
+    map->starts = SECTION(uint32_t, MAP_CACHE_STARTS);
+    map->ends = SECTION(uint32_t, MAP_CACHE_ENDS);
+    map->flags = SECTION(uint16_t, MAP_CACHE_FLAGS);
+    map->line_types = SECTION(uint16_t, MAP_CACHE_LINE_TYPES);
+    map->sector_tags = SECTION(uint16_t, MAP_CACHE_SECTOR_TAGS);
+    map->right_side_defs = SECTION(uint16_t, MAP_CACHE_RIGHT_SIDE_DEFS);
+    map->left_side_defs = SECTION(uint16_t, MAP_CACHE_LEFT_SIDE_DEFS);
+    map->front_sectors = SECTION(uint32_t, MAP_CACHE_FRONT_SECTORS);
+    map->back_sectors = SECTION(uint32_t, MAP_CACHE_BACK_SECTORS);
+    map->things = SECTION(Thing, MAP_CACHE_THINGS);
+    map->n_things = header.sections[MAP_CACHE_THINGS].count;
+    map->n_sidedefs = header.sections[MAP_CACHE_SIDEDEFS].count;
+    map->n_sectors = header.sections[MAP_CACHE_SECTORS].count;
+    if (intern_cached_names(SECTION(const Sidedef, MAP_CACHE_SIDEDEFS), SECTION(const Sector, MAP_CACHE_SECTORS),
+                SECTION(const uint64_t, MAP_CACHE_NAMES), header.sections[MAP_CACHE_NAMES].count, cache))
+        goto stale;
+
+    cache->nodes = SECTION(const Node, MAP_CACHE_NODES);
+    cache->n_nodes = header.sections[MAP_CACHE_NODES].count;
+    map->nodes = SECTION(Node, MAP_CACHE_NODES);
+    map->n_nodes = cache->n_nodes;
+    map->segs = SECTION(Seg, MAP_CACHE_SEGS);
+    map->n_segs = header.sections[MAP_CACHE_SEGS].count;
+    map->subsectors = SECTION(Subsector, MAP_CACHE_SUBSECTORS);
+    map->n_subsectors = header.sections[MAP_CACHE_SUBSECTORS].count;
+    cache->blockmap = SECTION(const int16_t, MAP_CACHE_BLOCKMAP);
+    cache->n_blockmap = header.sections[MAP_CACHE_BLOCKMAP].count;
+    cache->reject = SECTION(const uint8_t, MAP_CACHE_REJECT);
+    cache->reject_sz = header.sections[MAP_CACHE_REJECT].count;
+#undef SECTION
+
+    /* Check the indices once too, so a bad file cannot send walks out of bounds. */
+    if (check_map(map))
+        goto stale;
+
+    return 0;
+
+stale:
+    free(cache->named);
+    cache->named = NULL;
+    unload_wad(&cache->file);
+    return 1;
+}
+
+bool load_map_cache(const char *path, const MapLumps *lumps, MapCache *cache)
+{
+    const uint64_t source_hash = hash_map_lumps(lumps);
+
+    if (!open_map_cache(path, source_hash, cache))
+        return 0;
+
+    if (write_map_cache(path, lumps))
+        return 1;
+
+    return open_map_cache(path, source_hash, cache);
+}
+
+void close_map_cache(MapCache *cache)
+{
+    if (!cache)
+        return;
+
+    free(cache->named);
+    unload_wad(&cache->file);
+    *cache = (MapCache) { 0 };
+}
@@ -0,0 +1,135 @@
+#ifndef MAP_CACHE_H
+#define MAP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "map-lumps.h"
+
+/* Identifies map cache files, and the layout version they were written with. */
+#define MAP_CACHE_MAGIC 0x43505342u /* "BSPC" */
+#define MAP_CACHE_VERSION 5
+
+/* Sections start on cache line boundaries. */
+#define MAP_CACHE_ALIGN 64
+
+/* Sections of a map cache file; the Map arrays, then lumps kept as is. */
+typedef enum {
+    MAP_CACHE_XS,              /* int32_t */
+    MAP_CACHE_YS,              /* int32_t */
+    MAP_CACHE_STARTS,          /* uint32_t */
+    MAP_CACHE_ENDS,            /* uint32_t */
+    MAP_CACHE_FLAGS,           /* uint16_t */
+    MAP_CACHE_LINE_TYPES,      /* uint16_t */
+    MAP_CACHE_SECTOR_TAGS,     /* uint16_t */
+    MAP_CACHE_RIGHT_SIDE_DEFS, /* uint16_t */
+    MAP_CACHE_LEFT_SIDE_DEFS,  /* uint16_t */
+    MAP_CACHE_FRONT_SECTORS,   /* uint32_t */
+    MAP_CACHE_BACK_SECTORS,    /* uint32_t */
+    MAP_CACHE_THINGS,          /* Thing */
+    MAP_CACHE_SIDEDEFS,        /* Sidedef, textures indexing MAP_CACHE_NAMES */
+    MAP_CACHE_SECTORS,         /* Sector, flats indexing MAP_CACHE_NAMES */
+    MAP_CACHE_NAMES,           /* uint64_t packed names */
+    MAP_CACHE_NODES,           /* Node */
+    MAP_CACHE_SEGS,            /* Seg */
+    MAP_CACHE_SUBSECTORS,      /* Subsector */
+    MAP_CACHE_BLOCKMAP,        /* int16_t */
+    MAP_CACHE_REJECT,          /* uint8_t */
+    MAP_CACHE_SECTIONS
+} MapCacheSection;
+
+/* Where a section lies in the file. */
+typedef struct {
+    uint64_t offset;
+    uint64_t sz;
+    uint32_t count;
+    uint32_t record_sz;
+} MapCacheSectionEntry;
+
+/**
+ * Header at the start of a map cache file. Everything after it is found by
+ * offset, so the file holds no pointers and can be used wherever it is
+ * mapped. Values are stored in native byte order.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order; /* 0x01020304 as written by the machine */
+    uint32_t n_sections;
+    uint64_t source_hash; /* hash_map_lumps() of the lumps it was built from */
+    uint64_t file_sz;
+    MapCacheSectionEntry sections[MAP_CACHE_SECTIONS];
+} MapCacheHeader;
+
+/* A map cache file mapped into memory, with typed views of its sections. */
+typedef struct {
+    WAD file; /* not a WAD, but loaded the same way */
+
+    /**
+     * The map, as load_map() would give it, with its arrays pointing
+     * straight into the file. Never write to them: the file is mapped
+     * read-only. Name ids only hold within a process, so sidedefs and
+     * sectors are copied out of the file once with their names interned.
+     */
+    Map map;
+    void *named; // sidedefs then sectors, owned by the cache
+
+    const Node *nodes;
+    uint32_t n_nodes;
+
+    const int16_t *blockmap;
+    uint32_t n_blockmap;
+
+    const uint8_t *reject;
+    uint32_t reject_sz;
+} MapCache;
+
+/**
+ * @brief Hash the contents of every lump of a map.
+ *
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @returns The 64-bit hash.
+ */
+uint64_t hash_map_lumps(const MapLumps *lumps);
+
+/**
+ * @brief Decode a map and write it as a cache file.
+ *
+ * The file is written next to its final path and renamed into place, so
+ * readers never see a partial file.
+ *
+ * @param path The path to the cache file.
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @returns 0 on success, 1 on failure.
+ */
+bool write_map_cache(const char *path, const MapLumps *lumps);
+
+/**
+ * @brief Map a cache file and point the views at its sections.
+ *
+ * @param path The path to the cache file.
+ * @param source_hash The hash of the lumps the cache must have been built from.
+ * @param cache Pointer where to store the cache.
+ * @returns 0 on success, 1 if the file is missing, stale or invalid.
+ */
+bool open_map_cache(const char *path, uint64_t source_hash, MapCache *cache);
+
+/**
+ * @brief Open the cache of a map, building it first if it is missing or stale.
+ *
+ * @param path The path to the cache file.
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @param cache Pointer where to store the cache.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_map_cache(const char *path, const MapLumps *lumps, MapCache *cache);
+
+/**
+ * @brief Unmap a cache file.
+ *
+ * @param cache Pointer to the cache.
+ */
+void close_map_cache(MapCache *cache);
+
+#endif // MAP_CACHE_H
@@ -0,0 +1,108 @@
+#include "map-lumps.h"
+
+const char *const map_lump_names[MAP_LUMP_COUNT] = {
+    "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+    "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP",
+};
+
+const uint32_t map_lump_record_sizes[MAP_LUMP_COUNT] = {
+    10, 14, 30, 4, 12, 4, 28, 26, 1, 2,
+};
+
+/* Lumps a map cannot do without. */
+static const MapLumpType required_lumps[] = {
+    MAP_LUMP_THINGS, MAP_LUMP_LINEDEFS, MAP_LUMP_SIDEDEFS,
+    MAP_LUMP_VERTEXES, MAP_LUMP_SECTORS,
+};
+
+static int map_lump_type(const uint64_t keys[MAP_LUMP_COUNT], const uint64_t name)
+{
+    for (int i = 0; i < MAP_LUMP_COUNT; i++)
+        if (keys[i] == name)
+            return i;
+
+    return -1;
+}
+
+/**
+ * Collect the map lumps that follow the marker, stopping at the first lump
+ * that is not one, and check them.
+ */
+static bool resolve_marker(const WadIndex *index, const uint32_t marker, MapLumps *map)
+{
+    uint64_t keys[MAP_LUMP_COUNT];
+
+    map->marker = marker;
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        keys[i] = pack_lump_name(map_lump_names[i]);
+        map->nums[i] = WAD_NO_LUMP;
+    }
+
+    for (uint32_t lump = marker + 1; lump < index->n_lumps; lump++) {
+        const int type = map_lump_type(keys, index->lumps[lump].name);
+        if (type < 0 || map->nums[type] != WAD_NO_LUMP)
+            break;
+        if (index->lumps[lump].file != index->lumps[marker].file)
+            break;
+        if (index->lumps[lump].lump_size % map_lump_record_sizes[type])
+            return 1;
+        map->nums[type] = lump;
+    }
+
+    for (size_t i = 0; i < sizeof(required_lumps) / sizeof(required_lumps[0]); i++)
+        if (map->nums[required_lumps[i]] == WAD_NO_LUMP)
+            return 1;
+
+    return 0;
+}
+
+bool resolve_map_lumps(const WadIndex *index, const char *name, MapLumps *map)
+{
+    const uint32_t marker = find_lump_num(index, pack_lump_name(name));
+    if (marker == WAD_NO_LUMP)
+        return 1;
+
+    return resolve_marker(index, marker, map);
+}
+
+bool find_map_lumps(const WAD *wad, const WadIndex *index, const char *name, MapLumps *map)
+{
+    if (resolve_map_lumps(index, name, map))
+        return 1;
+
+    /* The index has already checked that every lump lies inside its WAD. */
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        if (map->nums[i] == WAD_NO_LUMP) {
+            map->spans[i] = (WadSpan) { NULL, 0 };
+        } else {
+            const WadLump *lump = &index->lumps[map->nums[i]];
+            map->spans[i] = (WadSpan) { wad[lump->file].data + lump->lump_offset, lump->lump_size };
+        }
+    }
+
+    return 0;
+}
+
+uint32_t list_maps(const WadIndex *index, uint32_t *markers, const uint32_t max)
+{
+    const uint64_t things = pack_lump_name("THINGS");
+    uint32_t count = 0;
+
+    /* Every map starts with a marker followed by THINGS. */
+    for (uint32_t lump = 0; lump + 1 < index->n_lumps; lump++) {
+        if (index->lumps[lump + 1].name != things)
+            continue;
+        if (find_lump_num(index, index->lumps[lump].name) != lump)
+            continue;
+
+        MapLumps map;
+        if (resolve_marker(index, lump, &map))
+            continue;
+
+        if (count < max)
+            markers[count] = lump;
+        count++;
+    }
+
+    return count;
+}
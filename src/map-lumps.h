@@ -0,0 +1,88 @@
+#ifndef MAP_LUMPS_H
+#define MAP_LUMPS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wad.h"
+#include "wad-index.h"
+
+/* Lumps of a map, in the order they follow the map marker. */
+typedef enum {
+    MAP_LUMP_THINGS,
+    MAP_LUMP_LINEDEFS,
+    MAP_LUMP_SIDEDEFS,
+    MAP_LUMP_VERTEXES,
+    MAP_LUMP_SEGS,
+    MAP_LUMP_SSECTORS,
+    MAP_LUMP_NODES,
+    MAP_LUMP_SECTORS,
+    MAP_LUMP_REJECT,
+    MAP_LUMP_BLOCKMAP,
+    MAP_LUMP_COUNT
+} MapLumpType;
+
+/* Names of the map lumps, indexed by MapLumpType. */
+extern const char *const map_lump_names[MAP_LUMP_COUNT];
+
+/* Size in bytes of one record of each map lump, indexed by MapLumpType. */
+extern const uint32_t map_lump_record_sizes[MAP_LUMP_COUNT];
+
+/* Every lump of one map. */
+typedef struct {
+    /**
+     * Lump number of the map marker (E1M1, MAP01, ...).
+     */
+    uint32_t marker;
+
+    /**
+     * Lump number of each map lump, or WAD_NO_LUMP when the map does
+     * not have it. THINGS, LINEDEFS, SIDEDEFS, VERTEXES and SECTORS are
+     * always present; nodes, REJECT and BLOCKMAP can be built instead.
+     */
+    uint32_t nums[MAP_LUMP_COUNT];
+
+    /**
+     * Contents of each map lump, already checked to lie inside the WAD
+     * and to be a whole number of records. Empty for missing lumps.
+     */
+    WadSpan spans[MAP_LUMP_COUNT];
+} MapLumps;
+
+/**
+ * @brief Resolve the lump numbers of a map from its marker name.
+ *
+ * Only fills in marker and nums; spans are left untouched.
+ *
+ * @param index Pointer to the index of the WAD.
+ * @param name The name of the map marker.
+ * @param map Pointer where to store the map lumps.
+ * @returns 0 on success, 1 if there is no such map or it is malformed.
+ */
+bool resolve_map_lumps(const WadIndex *index, const char *name, MapLumps *map);
+
+/**
+ * @brief Find a map and get spans over all of its lumps, in one lookup.
+ *
+ * @param wad Pointer to loaded WAD, or to the array of WADs a merged
+ *            index was built from.
+ * @param index Pointer to the index of the WAD.
+ * @param name The name of the map marker.
+ * @param map Pointer where to store the map lumps.
+ * @returns 0 on success, 1 if there is no such map or it is malformed.
+ */
+bool find_map_lumps(const WAD *wad, const WadIndex *index, const char *name, MapLumps *map);
+
+/**
+ * @brief List the markers of every map in the index.
+ *
+ * When a map is defined several times, only the one that lookups resolve
+ * to is listed.
+ *
+ * @param index Pointer to the index of the WAD.
+ * @param markers Array where to store the lump numbers of the markers.
+ * @param max Capacity of the markers array.
+ * @returns The number of maps, which may be more than max.
+ */
+uint32_t list_maps(const WadIndex *index, uint32_t *markers, uint32_t max);
+
+#endif // MAP_LUMPS_H
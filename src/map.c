@@ -0,0 +1,835 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+
+#include "map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#if defined(__SSE2__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MAP_SIMD 1
+#include <immintrin.h>
+#endif
+
+static inline void span_linedef(const WadSpan span, const size_t offset, Linedef *linedef)
+{
+    linedef->start_vertex = span_u16(span, offset);
+    linedef->end_vertex = span_u16(span, offset + 2);
+    linedef->flags = span_u16(span, offset + 4);
+    linedef->line_type = span_u16(span, offset + 6);
+    linedef->sector_tag = span_u16(span, offset + 8);
+    linedef->right_side_def = span_u16(span, offset + 10); // front
+    linedef->left_side_def = span_u16(span, offset + 12); // back
+}
+
+bool read_vertex(const WAD* wad, size_t offset, Vertex *vertex)
+{
+    WadSpan span;
+    const WadError err = vertex ? wad_span(wad, offset, 4, &span) : WAD_ERR_NULL;
+    if (err) {
+        fprintf(stderr, "Could not read vertex: %s.\n", wad_strerror(err));
+        return 1;
+    }
+
+    vertex->x = span_i16(span, 0);
+    vertex->y = span_i16(span, 2);
+
+    return 0;
+}
+
+bool read_linedef(const WAD* wad, size_t offset, Linedef *linedef)
+{
+    WadSpan span;
+    const WadError err = linedef ? wad_span(wad, offset, 14, &span) : WAD_ERR_NULL;
+    if (err) {
+        fprintf(stderr, "Could not read linedef: %s.\n", wad_strerror(err));
+        return 1;
+    }
+
+    span_linedef(span, 0, linedef);
+
+    return 0;
+}
+
+/* Arrays start on cache line boundaries. */
+#define MAP_ALIGN 64
+
+static inline size_t align_up(const size_t x)
+{
+    return (x + MAP_ALIGN - 1) & ~(size_t)(MAP_ALIGN - 1);
+}
+
+bool alloc_map(Map *map, LevelArena *arena, const uint32_t n_vertices, const uint32_t n_linedefs)
+{
+    const size_t vertex_sz = align_up((size_t)n_vertices * sizeof(int32_t));
+    const size_t index_sz = align_up((size_t)n_linedefs * sizeof(uint32_t));
+    const size_t field_sz = align_up((size_t)n_linedefs * sizeof(uint16_t));
+    const size_t total = 2 * vertex_sz + 2 * index_sz + 5 * field_sz;
+
+    uint8_t *p = (uint8_t *)arena_alloc(arena, total, MAP_ALIGN);
+    if (!p) {
+        fprintf(stderr, "Level arena too small for map.\n");
+        return 1;
+    }
+
+    *map = (Map) { 0 };
+    map->n_vertices = n_vertices;
+    map->n_linedefs = n_linedefs;
+    map->xs = (int32_t *)p;                 p += vertex_sz;
+    map->ys = (int32_t *)p;                 p += vertex_sz;
+    map->starts = (uint32_t *)p;            p += index_sz;
+    map->ends = (uint32_t *)p;              p += index_sz;
+    map->flags = (uint16_t *)p;             p += field_sz;
+    map->line_types = (uint16_t *)p;        p += field_sz;
+    map->sector_tags = (uint16_t *)p;       p += field_sz;
+    map->right_side_defs = (uint16_t *)p;   p += field_sz;
+    map->left_side_defs = (uint16_t *)p;
+
+    return 0;
+}
+
+/**
+ * Allocate an array of count records from the arena.
+ */
+static void *alloc_records(LevelArena *arena, const uint32_t count, const size_t record_sz)
+{
+    void *p = arena_alloc(arena, (count ? count : 1) * record_sz, MAP_ALIGN);
+    if (!p)
+        fprintf(stderr, "Level arena too small for map.\n");
+    return p;
+}
+
+/**
+ * Size the map from its lumps and allocate every array, so that the decode
+ * and link stages only write into memory they were given.
+ */
+static bool size_map(const WadSpan *spans, LevelArena *arena, Map *map)
+{
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        if (spans[i].sz % map_lump_record_sizes[i]) {
+            fprintf(stderr, "Map lump %s is not a whole number of records.\n", map_lump_names[i]);
+            return 1;
+        }
+    }
+    if (alloc_map(map, arena, (uint32_t)(spans[MAP_LUMP_VERTEXES].sz / 4),
+                (uint32_t)(spans[MAP_LUMP_LINEDEFS].sz / 14)))
+        return 1;
+
+    map->n_things = (uint32_t)(spans[MAP_LUMP_THINGS].sz / 10);
+    map->n_sidedefs = (uint32_t)(spans[MAP_LUMP_SIDEDEFS].sz / 30);
+    map->n_sectors = (uint32_t)(spans[MAP_LUMP_SECTORS].sz / 26);
+    map->n_segs = (uint32_t)(spans[MAP_LUMP_SEGS].sz / 12);
+    map->n_subsectors = (uint32_t)(spans[MAP_LUMP_SSECTORS].sz / 4);
+    map->n_nodes = (uint32_t)(spans[MAP_LUMP_NODES].sz / 28);
+
+    map->front_sectors = alloc_records(arena, map->n_linedefs, sizeof(uint32_t));
+    map->back_sectors = alloc_records(arena, map->n_linedefs, sizeof(uint32_t));
+    map->things = alloc_records(arena, map->n_things, sizeof(Thing));
+    map->sidedefs = alloc_records(arena, map->n_sidedefs, sizeof(Sidedef));
+    map->sectors = alloc_records(arena, map->n_sectors, sizeof(Sector));
+    map->segs = alloc_records(arena, map->n_segs, sizeof(Seg));
+    map->subsectors = alloc_records(arena, map->n_subsectors, sizeof(Subsector));
+    map->nodes = alloc_records(arena, map->n_nodes, sizeof(Node));
+    if (!map->front_sectors || !map->back_sectors || !map->things || !map->sidedefs
+            || !map->sectors || !map->segs || !map->subsectors || !map->nodes)
+        return 1;
+
+    return 0;
+}
+
+/*
+ * Decoders work on a range [first, end) of records so that large lumps can
+ * be split across threads. They only copy fields and intern names;
+ * references are checked by the link stage.
+ */
+
+static void decode_things(const WadSpan lump, const size_t first, const size_t end, Thing *things)
+{
+    for (size_t i = first; i < end; i++) {
+        const size_t o = i * 10;
+        things[i].x = span_i16(lump, o);
+        things[i].y = span_i16(lump, o + 2);
+        things[i].angle = span_i16(lump, o + 4);
+        things[i].type = span_u16(lump, o + 6);
+        things[i].flags = span_u16(lump, o + 8);
+    }
+}
+
+/* Records whose names are interned in one batch. */
+#define NAME_BATCH 256
+
+/**
+ * Pack n names of 8 bytes, stride bytes apart, starting at data.
+ */
+static void pack_names(const uint8_t *data, const size_t stride, const size_t n, uint64_t *keys)
+{
+    for (size_t i = 0; i < n; i++)
+        keys[i] = pack_name_bytes(data + i * stride);
+}
+
+static bool decode_sectors(const WadSpan lump, const size_t first, const size_t end, Sector *sectors)
+{
+    for (size_t batch = first; batch < end; batch += NAME_BATCH) {
+        const size_t n = end - batch < NAME_BATCH ? end - batch : NAME_BATCH;
+        uint64_t keys[2 * NAME_BATCH];
+        uint32_t ids[2 * NAME_BATCH];
+
+        /* Floor and ceiling names are adjacent in each record. */
+        for (size_t i = 0; i < n; i++)
+            pack_names(lump.data + (batch + i) * 26 + 4, 8, 2, &keys[2 * i]);
+        if (intern_names(keys, ids, 2 * n))
+            return 1;
+
+        for (size_t i = 0; i < n; i++) {
+            const size_t o = (batch + i) * 26;
+            Sector *sector = &sectors[batch + i];
+            sector->floor_height = span_i16(lump, o);
+            sector->ceiling_height = span_i16(lump, o + 2);
+            sector->floor_texture = ids[2 * i];
+            sector->ceiling_texture = ids[2 * i + 1];
+            sector->light_level = span_i16(lump, o + 20);
+            sector->special = span_u16(lump, o + 22);
+            sector->tag = span_u16(lump, o + 24);
+        }
+    }
+
+    return 0;
+}
+
+static bool decode_sidedefs(const WadSpan lump, const size_t first, const size_t end, Sidedef *sidedefs)
+{
+    for (size_t batch = first; batch < end; batch += NAME_BATCH) {
+        const size_t n = end - batch < NAME_BATCH ? end - batch : NAME_BATCH;
+        uint64_t keys[3 * NAME_BATCH];
+        uint32_t ids[3 * NAME_BATCH];
+
+        for (size_t i = 0; i < n; i++)
+            pack_names(lump.data + (batch + i) * 30 + 4, 8, 3, &keys[3 * i]);
+        if (intern_names(keys, ids, 3 * n))
+            return 1;
+
+        for (size_t i = 0; i < n; i++) {
+            const size_t o = (batch + i) * 30;
+            Sidedef *sidedef = &sidedefs[batch + i];
+            sidedef->x_offset = span_i16(lump, o);
+            sidedef->y_offset = span_i16(lump, o + 2);
+            sidedef->upper_texture = ids[3 * i];
+            sidedef->lower_texture = ids[3 * i + 1];
+            sidedef->middle_texture = ids[3 * i + 2];
+            sidedef->sector = span_u16(lump, o + 28);
+        }
+    }
+
+    return 0;
+}
+
+static void decode_linedef_range(const WadSpan lump, const size_t first, const size_t end, Map *map)
+{
+    size_t i = first;
+
+#if defined(MAP_SIMD)
+    /*
+     * Eight records per iteration: one 16-byte load per record puts its
+     * seven words in the low lanes, and an 8x8 transpose of 16-bit lanes
+     * turns the rows into one vector per field. Each load reads 2 bytes
+     * past its record, so the last record of the lump is left to the
+     * scalar loop.
+     */
+    for (; i + 8 <= end && (i + 8) * 14 + 2 <= lump.sz; i += 8) {
+        const uint8_t *p = lump.data + i * 14;
+        __m128i r[8], t[8], u[8];
+
+        for (size_t j = 0; j < 8; j++)
+            r[j] = _mm_loadu_si128((const __m128i *)(p + j * 14));
+        for (size_t j = 0; j < 8; j += 2) {
+            t[j / 2] = _mm_unpacklo_epi16(r[j], r[j + 1]);
+            t[j / 2 + 4] = _mm_unpackhi_epi16(r[j], r[j + 1]);
+        }
+        for (size_t j = 0; j < 8; j += 4) {
+            u[j] = _mm_unpacklo_epi32(t[j], t[j + 1]);
+            u[j + 1] = _mm_unpackhi_epi32(t[j], t[j + 1]);
+            u[j + 2] = _mm_unpacklo_epi32(t[j + 2], t[j + 3]);
+            u[j + 3] = _mm_unpackhi_epi32(t[j + 2], t[j + 3]);
+        }
+
+        /* u[0..3] hold fields 0-3 and u[4..7] fields 4-7, as pairs for records 0-3 then 4-7. */
+        const __m128i starts = _mm_unpacklo_epi64(u[0], u[2]);
+        const __m128i ends = _mm_unpackhi_epi64(u[0], u[2]);
+        const __m128i zero = _mm_setzero_si128();
+
+        _mm_storeu_si128((__m128i *)&map->starts[i], _mm_unpacklo_epi16(starts, zero));
+        _mm_storeu_si128((__m128i *)&map->starts[i + 4], _mm_unpackhi_epi16(starts, zero));
+        _mm_storeu_si128((__m128i *)&map->ends[i], _mm_unpacklo_epi16(ends, zero));
+        _mm_storeu_si128((__m128i *)&map->ends[i + 4], _mm_unpackhi_epi16(ends, zero));
+        _mm_storeu_si128((__m128i *)&map->flags[i], _mm_unpacklo_epi64(u[1], u[3]));
+        _mm_storeu_si128((__m128i *)&map->line_types[i], _mm_unpackhi_epi64(u[1], u[3]));
+        _mm_storeu_si128((__m128i *)&map->sector_tags[i], _mm_unpacklo_epi64(u[4], u[6]));
+        _mm_storeu_si128((__m128i *)&map->right_side_defs[i], _mm_unpackhi_epi64(u[4], u[6]));
+        _mm_storeu_si128((__m128i *)&map->left_side_defs[i], _mm_unpacklo_epi64(u[5], u[7]));
+    }
+#endif
+
+    for (; i < end; i++) {
+        const size_t o = i * 14;
+        map->starts[i] = span_u16(lump, o);
+        map->ends[i] = span_u16(lump, o + 2);
+        map->flags[i] = span_u16(lump, o + 4);
+        map->line_types[i] = span_u16(lump, o + 6);
+        map->sector_tags[i] = span_u16(lump, o + 8);
+        map->right_side_defs[i] = span_u16(lump, o + 10); // front
+        map->left_side_defs[i] = span_u16(lump, o + 12); // back
+    }
+}
+
+static void decode_segs(const WadSpan lump, const size_t first, const size_t end, Seg *segs)
+{
+    for (size_t i = first; i < end; i++) {
+        const size_t o = i * 12;
+        segs[i].start_vertex = span_u16(lump, o);
+        segs[i].end_vertex = span_u16(lump, o + 2);
+        segs[i].angle = span_i16(lump, o + 4);
+        segs[i].linedef = span_u16(lump, o + 6);
+        segs[i].direction = span_u16(lump, o + 8);
+        segs[i].offset = span_i16(lump, o + 10);
+    }
+}
+
+static void decode_subsectors(const WadSpan lump, const size_t first, const size_t end, Subsector *subsectors)
+{
+    for (size_t i = first; i < end; i++) {
+        subsectors[i].n_segs = span_u16(lump, i * 4);
+        subsectors[i].first_seg = span_u16(lump, i * 4 + 2);
+    }
+}
+
+static inline WadSpan record_range(const WadSpan lump, const size_t record_sz, const size_t first, const size_t end)
+{
+    return (WadSpan) { lump.data + first * record_sz, (end - first) * record_sz };
+}
+
+/**
+ * Decode records [first, end) of one map lump.
+ */
+static bool decode_map_range(const WadSpan *spans, const MapLumpType type, const size_t first, const size_t end, Map *map)
+{
+    const WadSpan lump = spans[type];
+
+    switch (type) {
+    case MAP_LUMP_THINGS:
+        decode_things(lump, first, end, map->things);
+        break;
+    case MAP_LUMP_LINEDEFS:
+        decode_linedef_range(lump, first, end, map);
+        break;
+    case MAP_LUMP_SIDEDEFS:
+        return decode_sidedefs(lump, first, end, map->sidedefs);
+    case MAP_LUMP_VERTEXES:
+        decode_vertexes(record_range(lump, 4, first, end), map->xs + first, map->ys + first);
+        break;
+    case MAP_LUMP_SEGS:
+        decode_segs(lump, first, end, map->segs);
+        break;
+    case MAP_LUMP_SSECTORS:
+        decode_subsectors(lump, first, end, map->subsectors);
+        break;
+    case MAP_LUMP_NODES:
+        decode_nodes(record_range(lump, 28, first, end), map->nodes + first);
+        break;
+    case MAP_LUMP_SECTORS:
+        return decode_sectors(lump, first, end, map->sectors);
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+/*
+ * The link stage checks references of records [first, end) and resolves
+ * them into direct indices. Ranges of one lump only write their own
+ * records, and only read fields set by the decode stage, except for
+ * subsectors which read the sectors resolved for segs.
+ */
+
+static bool link_sidedefs(const Map *map, const size_t first, const size_t end)
+{
+    for (size_t i = first; i < end; i++) {
+        if (map->sidedefs[i].sector >= map->n_sectors) {
+            fprintf(stderr, "Sidedef %zu references sector %u of %u.\n", i, map->sidedefs[i].sector, map->n_sectors);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static bool link_linedefs(Map *map, const size_t first, const size_t end)
+{
+    /* Check every vertex index once, so that render loops need not. */
+    uint32_t max_vertex = 0;
+    for (size_t i = first; i < end; i++) {
+        max_vertex = map->starts[i] > max_vertex ? map->starts[i] : max_vertex;
+        max_vertex = map->ends[i] > max_vertex ? map->ends[i] : max_vertex;
+    }
+    if (first < end && max_vertex >= map->n_vertices) {
+        fprintf(stderr, "Linedef references vertex %u of %u.\n", max_vertex, map->n_vertices);
+        return 1;
+    }
+
+    /* Every linedef has a front side; only two-sided ones have a back. */
+    for (size_t i = first; i < end; i++) {
+        const uint16_t right = map->right_side_defs[i];
+        const uint16_t left = map->left_side_defs[i];
+
+        if (right >= map->n_sidedefs || (left != MAP_NO_SIDEDEF && left >= map->n_sidedefs)) {
+            fprintf(stderr, "Linedef %zu references missing sidedefs.\n", i);
+            return 1;
+        }
+        map->front_sectors[i] = map->sidedefs[right].sector;
+        map->back_sectors[i] = left == MAP_NO_SIDEDEF ? MAP_NO_INDEX : map->sidedefs[left].sector;
+    }
+
+    return 0;
+}
+
+/**
+ * Check seg vertex and linedef references and resolve the side of the
+ * linedef they lie on. The sidedef is checked here too since linedefs may
+ * be linked concurrently.
+ */
+static bool link_segs(Map *map, const size_t first, const size_t end)
+{
+    for (size_t i = first; i < end; i++) {
+        Seg *seg = &map->segs[i];
+
+        if (seg->start_vertex >= map->n_vertices || seg->end_vertex >= map->n_vertices
+                || seg->linedef >= map->n_linedefs || seg->direction > 1) {
+            fprintf(stderr, "Seg %zu is malformed.\n", i);
+            return 1;
+        }
+
+        const uint16_t side = seg->direction
+            ? map->left_side_defs[seg->linedef]
+            : map->right_side_defs[seg->linedef];
+        if (side >= map->n_sidedefs) {
+            fprintf(stderr, "Seg %zu lies on a missing side of linedef %u.\n", i, seg->linedef);
+            return 1;
+        }
+        seg->sidedef = side;
+        seg->sector = map->sidedefs[side].sector;
+    }
+
+    return 0;
+}
+
+/**
+ * Check that every subsector is a non-empty run of segs, after the segs
+ * have been linked.
+ */
+static bool link_subsectors(Map *map, const size_t first, const size_t end)
+{
+    for (size_t i = first; i < end; i++) {
+        Subsector *subsector = &map->subsectors[i];
+
+        if (!subsector->n_segs || subsector->first_seg >= map->n_segs
+                || subsector->n_segs > map->n_segs - subsector->first_seg) {
+            fprintf(stderr, "Subsector %zu references segs beyond %u.\n", i, map->n_segs);
+            return 1;
+        }
+        subsector->sector = map->segs[subsector->first_seg].sector;
+    }
+
+    return 0;
+}
+
+/**
+ * Whether a child of node i exists. Child nodes must come before their
+ * parent, as node builders write them, so walks down the tree always end.
+ */
+static inline bool node_child_valid(const Map *map, const size_t i, const uint32_t child)
+{
+    if (child & NODE_SUBSECTOR)
+        return (child & ~NODE_SUBSECTOR) < map->n_subsectors;
+    return child < i;
+}
+
+static bool link_nodes(const Map *map, const size_t first, const size_t end)
+{
+    for (size_t i = first; i < end; i++) {
+        if (!node_child_valid(map, i, map->nodes[i].right_child) || !node_child_valid(map, i, map->nodes[i].left_child)) {
+            fprintf(stderr, "Node %zu references missing or later children.\n", i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Check that no path from the root holds more than MAP_MAX_NODE_DEPTH nodes.
+ * Children come before their parent, so one pass in order sees every child
+ * before the node that references it.
+ */
+static bool check_node_depth(const Map *map)
+{
+    bool ret = 1;
+    uint16_t *depths = (uint16_t *)malloc((map->n_nodes ? map->n_nodes : 1) * sizeof(uint16_t));
+    if (!depths) {
+        fprintf(stderr, "Failed to allocate memory for node depths.\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < map->n_nodes; i++) {
+        const uint32_t children[2] = { map->nodes[i].right_child, map->nodes[i].left_child };
+        uint16_t depth = 1;
+        for (int j = 0; j < 2; j++) {
+            if (!(children[j] & NODE_SUBSECTOR) && depths[children[j]] + 1 > depth)
+                depth = depths[children[j]] + 1;
+        }
+        if (depth > MAP_MAX_NODE_DEPTH) {
+            fprintf(stderr, "BSP tree is deeper than %d nodes at node %zu.\n", MAP_MAX_NODE_DEPTH, i);
+            goto exit_depths;
+        }
+        depths[i] = depth;
+    }
+    ret = 0;
+
+exit_depths:
+    free(depths);
+    return ret;
+}
+
+/**
+ * Check that the resolved references of a map agree with the ones they
+ * were resolved from, for maps whose link stage ran elsewhere.
+ */
+static bool check_resolved(const Map *map)
+{
+    for (size_t i = 0; i < map->n_linedefs; i++) {
+        const uint16_t right = map->right_side_defs[i];
+        const uint16_t left = map->left_side_defs[i];
+
+        if (map->starts[i] >= map->n_vertices || map->ends[i] >= map->n_vertices
+                || right >= map->n_sidedefs || (left != MAP_NO_SIDEDEF && left >= map->n_sidedefs)
+                || map->front_sectors[i] != map->sidedefs[right].sector
+                || map->back_sectors[i] != (left == MAP_NO_SIDEDEF ? MAP_NO_INDEX : map->sidedefs[left].sector)) {
+            fprintf(stderr, "Linedef %zu is malformed.\n", i);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < map->n_segs; i++) {
+        const Seg *seg = &map->segs[i];
+
+        if (seg->start_vertex >= map->n_vertices || seg->end_vertex >= map->n_vertices
+                || seg->linedef >= map->n_linedefs || seg->direction > 1
+                || seg->sidedef != (seg->direction ? map->left_side_defs : map->right_side_defs)[seg->linedef]
+                || seg->sidedef >= map->n_sidedefs || seg->sector != map->sidedefs[seg->sidedef].sector) {
+            fprintf(stderr, "Seg %zu is malformed.\n", i);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < map->n_subsectors; i++) {
+        const Subsector *subsector = &map->subsectors[i];
+
+        if (!subsector->n_segs || subsector->first_seg >= map->n_segs
+                || subsector->n_segs > map->n_segs - subsector->first_seg
+                || subsector->sector != map->segs[subsector->first_seg].sector) {
+            fprintf(stderr, "Subsector %zu references segs beyond %u.\n", i, map->n_segs);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+bool check_map(const Map *map)
+{
+    return link_sidedefs(map, 0, map->n_sidedefs)
+        || check_resolved(map)
+        || link_nodes(map, 0, map->n_nodes)
+        || check_node_depth(map);
+}
+
+/**
+ * Link records [first, end) of one map lump.
+ */
+static bool link_map_range(Map *map, const MapLumpType type, const size_t first, const size_t end)
+{
+    switch (type) {
+    case MAP_LUMP_LINEDEFS:
+        return link_linedefs(map, first, end);
+    case MAP_LUMP_SIDEDEFS:
+        return link_sidedefs(map, first, end);
+    case MAP_LUMP_SEGS:
+        return link_segs(map, first, end);
+    case MAP_LUMP_SSECTORS:
+        return link_subsectors(map, first, end);
+    case MAP_LUMP_NODES:
+        return link_nodes(map, first, end);
+    default:
+        return 0;
+    }
+}
+
+/* Number of records of each lump in a map. */
+static uint32_t map_lump_count(const Map *map, const MapLumpType type)
+{
+    switch (type) {
+    case MAP_LUMP_THINGS: return map->n_things;
+    case MAP_LUMP_LINEDEFS: return map->n_linedefs;
+    case MAP_LUMP_SIDEDEFS: return map->n_sidedefs;
+    case MAP_LUMP_VERTEXES: return map->n_vertices;
+    case MAP_LUMP_SEGS: return map->n_segs;
+    case MAP_LUMP_SSECTORS: return map->n_subsectors;
+    case MAP_LUMP_NODES: return map->n_nodes;
+    case MAP_LUMP_SECTORS: return map->n_sectors;
+    default: return 0;
+    }
+}
+
+/*
+ * Lumps linked in the first pass, then the ones that depend on them.
+ */
+static const MapLumpType link_order[][4] = {
+    { MAP_LUMP_SIDEDEFS, MAP_LUMP_LINEDEFS, MAP_LUMP_SEGS, MAP_LUMP_NODES },
+    { MAP_LUMP_SSECTORS, MAP_LUMP_COUNT, MAP_LUMP_COUNT, MAP_LUMP_COUNT },
+};
+
+bool load_map(const MapLumps *lumps, LevelArena *arena, Map *map)
+{
+    if (size_map(lumps->spans, arena, map))
+        return 1;
+
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        if (decode_map_range(lumps->spans, (MapLumpType)i, 0, map_lump_count(map, (MapLumpType)i), map))
+            return 1;
+    }
+
+    for (size_t pass = 0; pass < sizeof(link_order) / sizeof(link_order[0]); pass++) {
+        for (size_t i = 0; i < 4 && link_order[pass][i] != MAP_LUMP_COUNT; i++) {
+            const MapLumpType type = link_order[pass][i];
+            if (link_map_range(map, type, 0, map_lump_count(map, type)))
+                return 1;
+        }
+    }
+
+    return check_node_depth(map);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* One range of records handed to a thread. */
+typedef struct {
+    const WadSpan *spans;
+    Map *map;
+    MapLumpType type;
+    uint32_t first, end;
+    atomic_bool *failed;
+    _Atomic uint64_t *ns; // time spent on the lump, summed over threads
+} MapLoadJob;
+
+static void decode_job(void *arg)
+{
+    const MapLoadJob *job = (const MapLoadJob *)arg;
+    const uint64_t start = now_ns();
+
+    if (decode_map_range(job->spans, job->type, job->first, job->end, job->map))
+        atomic_store(job->failed, true);
+    atomic_fetch_add(job->ns, now_ns() - start);
+}
+
+static void link_job(void *arg)
+{
+    const MapLoadJob *job = (const MapLoadJob *)arg;
+
+    if (!atomic_load_explicit(job->failed, memory_order_relaxed)
+            && link_map_range(job->map, job->type, job->first, job->end))
+        atomic_store(job->failed, true);
+}
+
+/**
+ * Split the given lumps into jobs of at most MAP_LOAD_JOB_RECORDS records,
+ * and run them on the pool.
+ */
+static bool run_map_jobs(ThreadPool *pool, const MapLumpType *types, const size_t n_types,
+        void (*fn)(void *), MapLoadJob *jobs, Task *tasks, const MapLoadJob *proto)
+{
+    size_t n_jobs = 0;
+
+    for (size_t i = 0; i < n_types && types[i] != MAP_LUMP_COUNT; i++) {
+        const uint32_t count = map_lump_count(proto->map, types[i]);
+
+        for (uint32_t first = 0; first < count; first += MAP_LOAD_JOB_RECORDS) {
+            jobs[n_jobs] = *proto;
+            jobs[n_jobs].type = types[i];
+            jobs[n_jobs].first = first;
+            jobs[n_jobs].end = count - first > MAP_LOAD_JOB_RECORDS ? first + MAP_LOAD_JOB_RECORDS : count;
+            jobs[n_jobs].ns = &proto->ns[types[i]];
+            tasks[n_jobs] = (Task) { fn, &jobs[n_jobs] };
+            n_jobs++;
+        }
+    }
+
+    return run_tasks(pool, tasks, n_jobs);
+}
+
+bool load_map_parallel(const MapLumps *lumps, LevelArena *arena, ThreadPool *pool, Map *map, MapLoadStats *stats)
+{
+    static const MapLumpType decode_order[] = {
+        MAP_LUMP_THINGS, MAP_LUMP_LINEDEFS, MAP_LUMP_SIDEDEFS, MAP_LUMP_VERTEXES,
+        MAP_LUMP_SEGS, MAP_LUMP_SSECTORS, MAP_LUMP_NODES, MAP_LUMP_SECTORS,
+    };
+    MapLoadStats local;
+    bool ret = 1;
+
+    if (!stats)
+        stats = &local;
+    *stats = (MapLoadStats) { 0 };
+
+    const uint64_t start = now_ns();
+    if (size_map(lumps->spans, arena, map))
+        return 1;
+    stats->alloc_ns = now_ns() - start;
+
+    /* Enough jobs for every lump of the map, split into ranges. */
+    size_t n_jobs = 0;
+    for (int i = 0; i < MAP_LUMP_COUNT; i++)
+        n_jobs += (map_lump_count(map, (MapLumpType)i) + MAP_LOAD_JOB_RECORDS - 1) / MAP_LOAD_JOB_RECORDS;
+
+    MapLoadJob *jobs = (MapLoadJob *)malloc((n_jobs ? n_jobs : 1) * sizeof(MapLoadJob));
+    Task *tasks = (Task *)malloc((n_jobs ? n_jobs : 1) * sizeof(Task));
+    _Atomic uint64_t lump_ns[MAP_LUMP_COUNT];
+    atomic_bool failed;
+    if (!jobs || !tasks) {
+        fprintf(stderr, "Failed to allocate memory for map load jobs.\n");
+        goto exit_jobs;
+    }
+    for (int i = 0; i < MAP_LUMP_COUNT; i++)
+        atomic_init(&lump_ns[i], 0);
+    atomic_init(&failed, false);
+
+    const MapLoadJob proto = { lumps->spans, map, MAP_LUMP_COUNT, 0, 0, &failed, lump_ns };
+
+    const uint64_t decode_start = now_ns();
+    if (run_map_jobs(pool, decode_order, sizeof(decode_order) / sizeof(decode_order[0]), decode_job, jobs, tasks, &proto)
+            || atomic_load(&failed))
+        goto exit_jobs;
+    const uint64_t link_start = now_ns();
+    stats->decode_ns = link_start - decode_start;
+
+    for (size_t pass = 0; pass < sizeof(link_order) / sizeof(link_order[0]); pass++) {
+        if (run_map_jobs(pool, link_order[pass], 4, link_job, jobs, tasks, &proto) || atomic_load(&failed))
+            goto exit_jobs;
+    }
+    if (check_node_depth(map))
+        goto exit_jobs;
+    stats->link_ns = now_ns() - link_start;
+
+    for (int i = 0; i < MAP_LUMP_COUNT; i++)
+        stats->lump_ns[i] = atomic_load(&lump_ns[i]);
+    stats->total_ns = now_ns() - start;
+    ret = 0;
+
+exit_jobs:
+    free(tasks);
+    free(jobs);
+    return ret;
+}
+
+#if defined(MAP_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+/**
+ * Split and sign-extend 8 vertices per iteration.
+ */
+__attribute__((target("avx2")))
+static size_t decode_vertexes_avx2(const WadSpan lump, int32_t *xs, int32_t *ys)
+{
+    const size_t n = lump.sz / 4;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(lump.data + i * 4));
+        _mm256_storeu_si256((__m256i *)&xs[i], _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+        _mm256_storeu_si256((__m256i *)&ys[i], _mm256_srai_epi32(v, 16));
+    }
+
+    return i;
+}
+#endif
+
+bool decode_vertexes(const WadSpan lump, int32_t *xs, int32_t *ys)
+{
+    if (lump.sz % 4)
+        return 1;
+
+    const size_t n = lump.sz / 4;
+    size_t i = 0;
+
+#if defined(MAP_SIMD)
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        i = decode_vertexes_avx2(lump, xs, ys);
+#endif
+    /*
+     * Each vertex is one 32-bit lane with x in the low half and y in the
+     * high half: arithmetic shifts split and sign-extend them at once.
+     */
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(lump.data + i * 4));
+        _mm_storeu_si128((__m128i *)&xs[i], _mm_srai_epi32(_mm_slli_epi32(v, 16), 16));
+        _mm_storeu_si128((__m128i *)&ys[i], _mm_srai_epi32(v, 16));
+    }
+#endif
+
+    for (; i < n; i++) {
+        xs[i] = span_i16(lump, i * 4);
+        ys[i] = span_i16(lump, i * 4 + 2);
+    }
+
+    return 0;
+}
+
+bool decode_linedefs(const WadSpan lump, Map *map)
+{
+    if (lump.sz % 14 || lump.sz / 14 != map->n_linedefs)
+        return 1;
+
+    decode_linedef_range(lump, 0, map->n_linedefs, map);
+
+    return 0;
+}
+
+static inline uint32_t widen_node_child(const uint16_t child)
+{
+    return child & LUMP_NODE_SUBSECTOR ? NODE_SUBSECTOR | (child & ~LUMP_NODE_SUBSECTOR) : child;
+}
+
+bool decode_nodes(const WadSpan lump, Node *nodes)
+{
+    if (lump.sz % 28)
+        return 1;
+
+    for (size_t i = 0; i < lump.sz / 28; i++) {
+        const size_t o = i * 28;
+        nodes[i].x = span_i16(lump, o);
+        nodes[i].y = span_i16(lump, o + 2);
+        nodes[i].dx = span_i16(lump, o + 4);
+        nodes[i].dy = span_i16(lump, o + 6);
+        for (size_t j = 0; j < 4; j++) {
+            nodes[i].right_box[j] = span_i16(lump, o + 8 + 2 * j);
+            nodes[i].left_box[j] = span_i16(lump, o + 16 + 2 * j);
+        }
+        nodes[i].right_child = widen_node_child(span_u16(lump, o + 24));
+        nodes[i].left_child = widen_node_child(span_u16(lump, o + 26));
+    }
+
+    return 0;
+}
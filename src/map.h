@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include "vector.h"
 #include "wad.h"
+#include "map-lumps.h"
+#include "arena.h"
+#include "thread-pool.h"
+#include "name-table.h"
 
 typedef vector2i_t Vertex;
 
@@ -13,14 +17,237 @@ typedef struct {
              left_side_def, right_side_def;
 } Linedef;
 
+/* Index used for references to nothing, such as the back of a one-sided line. */
+#define MAP_NO_INDEX UINT32_MAX
+
+/* Sidedef number of a missing side in the LINEDEFS lump. */
+#define MAP_NO_SIDEDEF 0xFFFF
+
+/* Bit set in Node children that refer to subsectors rather than nodes. */
+#define NODE_SUBSECTOR 0x80000000u
+
+/* Bit set in the 16-bit children of the NODES lump for subsectors. */
+#define LUMP_NODE_SUBSECTOR 0x8000
+
+/* Most nodes on any path from the root; deeper trees are rejected on load. */
+#define MAP_MAX_NODE_DEPTH 1024
+
+typedef struct {
+    int16_t x, y;
+    int16_t angle; // degrees
+    uint16_t type, flags;
+} Thing;
+
+typedef struct {
+    int16_t x_offset, y_offset;
+    uint32_t upper_texture, lower_texture, middle_texture; // interned, NAME_NONE for "-"
+    uint32_t sector; // checked to be less than n_sectors
+} Sidedef;
+
+typedef struct {
+    int16_t floor_height, ceiling_height;
+    uint32_t floor_texture, ceiling_texture; // interned
+    int16_t light_level;
+    uint16_t special, tag;
+} Sector;
+
+typedef struct {
+    uint32_t start_vertex, end_vertex;
+    uint32_t linedef;
+    uint32_t sidedef, sector; // resolved through the linedef side
+    int16_t angle; // binary angle, full circle is 65536
+    int16_t offset; // along the linedef
+    uint16_t direction; // 0 on the front side of the linedef, 1 on the back
+} Seg;
+
+typedef struct {
+    uint32_t first_seg, n_segs;
+    uint32_t sector; // sector of the first seg
+} Subsector;
+
+/**
+ * Node of the BSP tree, as stored in the NODES lump but with children
+ * widened to indices into the node or subsector arrays. Nodes fill half a
+ * cache line and refer to each other by index only, so a tree can be
+ * walked straight out of a mapped cache file.
+ */
+typedef struct {
+    int16_t x, y, dx, dy; // partition line
+    int16_t right_box[4], left_box[4]; // top, bottom, left, right
+    uint32_t right_child, left_child; // NODE_SUBSECTOR set for subsectors
+} Node;
+
+/**
+ * A level. Geometry is stored as one array per field in a single block of
+ * the level arena; the other lumps are compact arrays in the same arena.
+ * Everything is sized from the lumps when the map is loaded and goes away
+ * with the arena.
+ *
+ * Every index stored in these arrays has been checked once by load_map(),
+ * or by check_map() for maps from elsewhere, so it can be used without
+ * bounds checks.
+ */
 typedef struct {
-    uint8_t n_vertices, n_linedefs;
-    Vertex vertices[255];
-    Linedef linedefs[255];
+    uint32_t n_vertices, n_linedefs;
+
+    /**
+     * Vertex coordinates.
+     */
+    int32_t *xs, *ys;
+
+    /**
+     * Linedef vertex indices, checked to be less than n_vertices.
+     */
+    uint32_t *starts, *ends;
+
+    /**
+     * Remaining linedef fields, as in Linedef.
+     */
+    uint16_t *flags, *line_types, *sector_tags,
+             *left_side_defs, *right_side_defs;
+
+    /**
+     * Sectors on the front and back of each linedef, resolved through its
+     * sidedefs. The back is MAP_NO_INDEX for one-sided lines.
+     */
+    uint32_t *front_sectors, *back_sectors;
+
+    uint32_t n_things, n_sidedefs, n_sectors, n_segs, n_subsectors, n_nodes;
+    Thing *things;
+    Sidedef *sidedefs;
+    Sector *sectors;
+    Seg *segs;
+    Subsector *subsectors;
+    Node *nodes; // root is the last node, children come before their parent
 } Map;
 
+/**
+ * @brief Allocate the arrays of a map in a single block.
+ *
+ * @param map Pointer to the map.
+ * @param arena Pointer to the arena of the level.
+ * @param n_vertices Number of vertices.
+ * @param n_linedefs Number of linedefs.
+ * @returns 0 on success, 1 on failure.
+ */
+bool alloc_map(Map *map, LevelArena *arena, uint32_t n_vertices, uint32_t n_linedefs);
+
+/**
+ * @brief Decode every lump of a map.
+ *
+ * The map is sized from the lump lengths. Cross-references (linedef
+ * vertices and sidedefs, sidedef sectors, seg vertices and linedefs,
+ * subsector segs, node children) are checked once here and resolved into
+ * direct indices, so that later loops need not check them. Texture and
+ * flat names are interned into ids. The nodes,
+ * segs and subsectors are optional; their counts are 0 if missing.
+ *
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @param arena Pointer to the arena of the level.
+ * @param map Pointer where to store the map.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_map(const MapLumps *lumps, LevelArena *arena, Map *map);
+
+/**
+ * @brief Check every index of a map that was not built by load_map().
+ *
+ * Runs the reference checks of load_map() without writing to the map, and
+ * checks that resolved fields (linedef sectors, seg sidedefs and sectors,
+ * subsector sectors) agree with what they were resolved from. Also checks
+ * the depth of the BSP tree.
+ *
+ * @param map Pointer to the map.
+ * @returns 0 if the map is valid, 1 otherwise.
+ */
+bool check_map(const Map *map);
+
+/* Records of one lump handed to a thread at a time by load_map_parallel(). */
+#define MAP_LOAD_JOB_RECORDS 16384
+
+/* Wall time of each stage of load_map_parallel(), in nanoseconds. */
+typedef struct {
+    uint64_t alloc_ns; // sizing and arena allocation
+    uint64_t decode_ns; // all lumps, concurrently
+    uint64_t link_ns; // reference checks and resolution
+    uint64_t total_ns;
+
+    /**
+     * Time spent decoding each lump, summed over the threads that worked
+     * on it. Indexed by MapLumpType.
+     */
+    uint64_t lump_ns[MAP_LUMP_COUNT];
+} MapLoadStats;
+
+/**
+ * @brief Decode every lump of a map on a thread pool.
+ *
+ * Same result as load_map(), in stages: the arrays are allocated up front
+ * from the arena, then every lump is decoded concurrently in ranges of at
+ * most MAP_LOAD_JOB_RECORDS records, then references are checked and
+ * resolved, again in ranges. load_level() follows with the derived tables.
+ *
+ * @param lumps Pointer to the map lumps, with their spans.
+ * @param arena Pointer to the arena of the level.
+ * @param pool Pointer to the thread pool, or NULL to run on this thread.
+ * @param map Pointer where to store the map.
+ * @param stats Pointer where to store stage timings, or NULL.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_map_parallel(const MapLumps *lumps, LevelArena *arena, ThreadPool *pool, Map *map, MapLoadStats *stats);
+
+/**
+ * @brief Read one vertex from a VERTEXES lump.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param offset Offset of the vertex.
+ * @param vertex Pointer where to store the vertex.
+ * @returns 0 on success, 1 on failure.
+ */
 bool read_vertex(const WAD* wad, size_t offset, Vertex *vertex);
 
+/**
+ * @brief Read one linedef from a LINEDEFS lump.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param offset Offset of the linedef.
+ * @param linedef Pointer where to store the linedef.
+ * @returns 0 on success, 1 on failure.
+ */
 bool read_linedef(const WAD* wad, size_t offset, Linedef *linedef);
 
-#endif // MAP_H
\ No newline at end of file
+/**
+ * @brief Decode a whole VERTEXES lump at once into coordinate arrays.
+ *
+ * The lump is checked once; records are then split and widened with SIMD
+ * when the CPU supports it.
+ *
+ * @param lump Span over the lump.
+ * @param xs Array of lump.sz / 4 x coordinates to fill.
+ * @param ys Array of lump.sz / 4 y coordinates to fill.
+ * @returns 0 on success, 1 if the lump is not a whole number of vertices.
+ */
+bool decode_vertexes(WadSpan lump, int32_t *xs, int32_t *ys);
+
+/**
+ * @brief Decode a whole LINEDEFS lump at once into the linedef arrays.
+ *
+ * @param lump Span over the lump.
+ * @param map Pointer to a map allocated for lump.sz / 14 linedefs.
+ * @returns 0 on success, 1 if the lump does not match the map.
+ */
+bool decode_linedefs(WadSpan lump, Map *map);
+
+/**
+ * @brief Decode a whole NODES lump at once.
+ *
+ * Children are widened to 32 bits, moving the subsector flag to
+ * NODE_SUBSECTOR.
+ *
+ * @param lump Span over the lump.
+ * @param nodes Array of lump.sz / 28 nodes to fill.
+ * @returns 0 on success, 1 if the lump is not a whole number of nodes.
+ */
+bool decode_nodes(WadSpan lump, Node *nodes);
+
+#endif // MAP_H
@@ -0,0 +1,169 @@
+#include "name-table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* Packed "-". */
+#define NONE_KEY ((uint64_t)'-')
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Packed name of each id. */
+static uint64_t *names;
+static uint32_t n_names, max_names;
+
+/*
+ * Open addressing hash table from packed name to id. Empty slots hold
+ * NAME_NOT_FOUND.
+ */
+static uint32_t *slots;
+static uint32_t capacity;
+
+static inline uint32_t hash_key(uint64_t key)
+{
+    /* Same folding as the WAD index: names differ in their high bytes. */
+    key ^= key >> 33;
+    key *= 0x9E3779B97F4A7C15ull;
+    key ^= key >> 29;
+    return (uint32_t)key & (capacity - 1);
+}
+
+static uint32_t find_slot(const uint64_t key)
+{
+    uint32_t slot = hash_key(key);
+    while (slots[slot] != NAME_NOT_FOUND && names[slots[slot]] != key)
+        slot = (slot + 1) & (capacity - 1);
+    return slot;
+}
+
+/**
+ * Make room for one more name, keeping the load factor at most one half.
+ * Must be called with the lock held.
+ */
+static bool reserve_name(void)
+{
+    if (n_names == max_names) {
+        const uint32_t max = max_names ? 2 * max_names : 256;
+        uint64_t *p = (uint64_t *)realloc(names, max * sizeof(uint64_t));
+        if (!p)
+            return 1;
+        names = p;
+        max_names = max;
+    }
+
+    if (2 * (n_names + 1) > capacity) {
+        const uint32_t old_capacity = capacity;
+        uint32_t *old_slots = slots;
+
+        capacity = capacity ? 2 * capacity : 512;
+        slots = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+        if (!slots) {
+            slots = old_slots;
+            capacity = old_capacity;
+            return 1;
+        }
+        for (uint32_t i = 0; i < capacity; i++)
+            slots[i] = NAME_NOT_FOUND;
+        for (uint32_t i = 0; i < n_names; i++)
+            slots[find_slot(names[i])] = i;
+        free(old_slots);
+    }
+
+    return 0;
+}
+
+/**
+ * Intern one name. Must be called with the lock held.
+ */
+static uint32_t intern_locked(uint64_t key)
+{
+    if (!key)
+        key = NONE_KEY;
+
+    if (capacity) {
+        const uint32_t slot = find_slot(key);
+        if (slots[slot] != NAME_NOT_FOUND)
+            return slots[slot];
+    }
+
+    /* "-" always gets NAME_NONE, so intern it first. */
+    if (!n_names && key != NONE_KEY && intern_locked(NONE_KEY) == NAME_NOT_FOUND)
+        return NAME_NOT_FOUND;
+    if (reserve_name())
+        return NAME_NOT_FOUND;
+
+    names[n_names] = key;
+    slots[find_slot(key)] = n_names;
+    return n_names++;
+}
+
+bool intern_names(const uint64_t *keys, uint32_t *ids, const size_t n)
+{
+    bool ret = 0;
+
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = intern_locked(keys[i]);
+        if (ids[i] == NAME_NOT_FOUND) {
+            fprintf(stderr, "Failed to allocate memory for name table.\n");
+            ret = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+bool intern_name(const uint64_t key, uint32_t *id)
+{
+    return intern_names(&key, id, 1);
+}
+
+uint32_t find_name(uint64_t key)
+{
+    uint32_t id = NAME_NOT_FOUND;
+
+    if (!key)
+        key = NONE_KEY;
+
+    pthread_mutex_lock(&lock);
+    if (capacity)
+        id = slots[find_slot(key)];
+    pthread_mutex_unlock(&lock);
+
+    return id;
+}
+
+uint64_t name_key(const uint32_t id)
+{
+    uint64_t key = 0;
+
+    pthread_mutex_lock(&lock);
+    if (id < n_names)
+        key = names[id];
+    pthread_mutex_unlock(&lock);
+
+    return key;
+}
+
+uint32_t count_names(void)
+{
+    pthread_mutex_lock(&lock);
+    const uint32_t n = n_names;
+    pthread_mutex_unlock(&lock);
+
+    return n;
+}
+
+void clear_names(void)
+{
+    pthread_mutex_lock(&lock);
+    free(names);
+    free(slots);
+    names = NULL;
+    slots = NULL;
+    n_names = max_names = capacity = 0;
+    pthread_mutex_unlock(&lock);
+}
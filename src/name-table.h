@@ -0,0 +1,78 @@
+#ifndef NAME_TABLE_H
+#define NAME_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Id of the "-" name, which sidedefs use for no texture. The empty name
+ * maps to it too.
+ */
+#define NAME_NONE 0
+
+/* Id returned when a name has not been interned. */
+#define NAME_NOT_FOUND UINT32_MAX
+
+/*
+ * Every texture, flat and lump name seen so far, interned into dense ids.
+ * Names are keys made by pack_lump_name(), so they are case-folded and
+ * compare as integers. Ids are never reused, so they stay valid from one
+ * level to the next; the table is shared by all threads.
+ */
+
+/**
+ * @brief Intern a packed name.
+ *
+ * @param key The packed name.
+ * @param id Pointer where to store the id of the name.
+ * @returns 0 on success, 1 on failure.
+ */
+bool intern_name(uint64_t key, uint32_t *id);
+
+/**
+ * @brief Intern packed names in one go.
+ *
+ * The table is locked once for the whole batch, so decoders should
+ * gather names before interning them.
+ *
+ * @param keys Array of packed names.
+ * @param ids Array where to store the id of each name.
+ * @param n Number of names.
+ * @returns 0 on success, 1 on failure.
+ */
+bool intern_names(const uint64_t *keys, uint32_t *ids, size_t n);
+
+/**
+ * @brief Look up the id of a packed name without interning it.
+ *
+ * @param key The packed name.
+ * @returns The id of the name, or NAME_NOT_FOUND.
+ */
+uint32_t find_name(uint64_t key);
+
+/**
+ * @brief Get the packed name of an id.
+ *
+ * @param id The id of the name.
+ * @returns The packed name, or 0 if the id is unknown.
+ */
+uint64_t name_key(uint32_t id);
+
+/**
+ * @brief Get the number of names interned so far.
+ *
+ * Ids are less than this, so it sizes arrays indexed by id.
+ *
+ * @returns The number of names.
+ */
+uint32_t count_names(void);
+
+/**
+ * @brief Forget every name and free the table.
+ *
+ * Ids handed out before are no longer valid.
+ */
+void clear_names(void);
+
+#endif // NAME_TABLE_H
@@ -0,0 +1,85 @@
+#include "prefetch.h"
+
+#include <string.h>
+
+static void release_lumps(MapPrefetch *prefetch, const int count)
+{
+    for (int i = 0; i < count; i++)
+        if (prefetch->lumps.nums[i] != WAD_NO_LUMP)
+            release_lump(prefetch->cache, prefetch->lumps.nums[i]);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    MapPrefetch *prefetch = (MapPrefetch *)arg;
+    MapLumps *lumps = &prefetch->lumps;
+
+    if (resolve_map_lumps(&prefetch->cache->index, prefetch->name, lumps)) {
+        atomic_store(&prefetch->state, PREFETCH_FAILED);
+        return NULL;
+    }
+
+    for (int i = 0; i < MAP_LUMP_COUNT; i++) {
+        if (lumps->nums[i] == WAD_NO_LUMP) {
+            lumps->spans[i] = (WadSpan) { NULL, 0 };
+        } else if (acquire_lump(prefetch->cache, lumps->nums[i], &lumps->spans[i])) {
+            release_lumps(prefetch, i);
+            atomic_store(&prefetch->state, PREFETCH_FAILED);
+            return NULL;
+        }
+    }
+
+    if (prefetch->arena && load_map(lumps, prefetch->arena, &prefetch->map)) {
+        release_lumps(prefetch, MAP_LUMP_COUNT);
+        atomic_store(&prefetch->state, PREFETCH_FAILED);
+        return NULL;
+    }
+
+    atomic_store(&prefetch->state, PREFETCH_DONE);
+    return NULL;
+}
+
+bool start_map_prefetch(MapPrefetch *prefetch, LumpCache *cache, const char *name, LevelArena *arena)
+{
+    prefetch->cache = cache;
+    prefetch->arena = arena;
+    strncpy(prefetch->name, name, 8);
+    prefetch->name[8] = '\0';
+    atomic_init(&prefetch->state, PREFETCH_PENDING);
+    prefetch->joined = false;
+
+    if (pthread_create(&prefetch->thread, NULL, prefetch_thread, prefetch)) {
+        atomic_store(&prefetch->state, PREFETCH_FAILED);
+        prefetch->joined = true;
+        prefetch->cache = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+PrefetchState poll_map_prefetch(const MapPrefetch *prefetch)
+{
+    return (PrefetchState)atomic_load(&prefetch->state);
+}
+
+PrefetchState wait_map_prefetch(MapPrefetch *prefetch)
+{
+    /* The thread is joined once; later calls just return the state. */
+    if (!prefetch->joined) {
+        pthread_join(prefetch->thread, NULL);
+        prefetch->joined = true;
+    }
+
+    return poll_map_prefetch(prefetch);
+}
+
+void release_map_prefetch(MapPrefetch *prefetch)
+{
+    if (!prefetch->cache)
+        return;
+
+    if (wait_map_prefetch(prefetch) == PREFETCH_DONE)
+        release_lumps(prefetch, MAP_LUMP_COUNT);
+    prefetch->cache = NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lump-cache.h"
+#include "map-lumps.h"
+#include "map.h"
+#include "arena.h"
+
+/* State of a prefetch. */
+typedef enum {
+    PREFETCH_PENDING,
+    PREFETCH_DONE,
+    PREFETCH_FAILED,
+} PrefetchState;
+
+/* Handle of a map being read in the background. */
+typedef struct {
+    LumpCache *cache;
+    char name[9];
+
+    /**
+     * Lumps of the map. Once the prefetch is done, every span points at
+     * a lump pinned in the cache until release_map_prefetch().
+     */
+    MapLumps lumps;
+
+    /**
+     * Arena of the next level, owned by the I/O thread until the prefetch
+     * is done, and the map decoded into it. NULL to only read the lumps.
+     */
+    LevelArena *arena;
+    Map map;
+
+    atomic_int state;
+    pthread_t thread;
+    bool joined;
+} MapPrefetch;
+
+/**
+ * @brief Start reading, and decoding, every lump of a map on an I/O thread.
+ *
+ * The arena must not be touched until the prefetch is done.
+ *
+ * @param prefetch Pointer where to store the handle.
+ * @param cache Pointer to the cache to read the lumps into.
+ * @param name The name of the map marker.
+ * @param arena Pointer to the arena to decode the map into, or NULL.
+ * @returns 0 on success, 1 if the thread could not be started.
+ */
+bool start_map_prefetch(MapPrefetch *prefetch, LumpCache *cache, const char *name, LevelArena *arena);
+
+/**
+ * @brief Get the state of a prefetch without blocking.
+ *
+ * @param prefetch Pointer to the handle.
+ * @returns The state of the prefetch.
+ */
+PrefetchState poll_map_prefetch(const MapPrefetch *prefetch);
+
+/**
+ * @brief Block until a prefetch is done.
+ *
+ * @param prefetch Pointer to the handle.
+ * @returns PREFETCH_DONE or PREFETCH_FAILED.
+ */
+PrefetchState wait_map_prefetch(MapPrefetch *prefetch);
+
+/**
+ * @brief Wait for a prefetch and unpin its lumps.
+ *
+ * @param prefetch Pointer to the handle.
+ */
+void release_map_prefetch(MapPrefetch *prefetch);
+
+#endif // PREFETCH_H
@@ -0,0 +1,230 @@
+#include "reject.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sectors handed to a thread at a time by build_reject(). */
+#define REJECT_JOB_SECTORS 16
+
+/**
+ * Allocate a table with every bit clear.
+ */
+static bool alloc_reject(const Map *map, LevelArena *arena, Reject *reject)
+{
+    reject->n_sectors = map->n_sectors;
+    /* Whole cache lines per row, so that threads filling rows never share one. */
+    reject->row_words = (uint32_t)((bitset_words(map->n_sectors) + 7) & ~(size_t)7);
+
+    const size_t sz = (size_t)reject->n_sectors * reject->row_words * sizeof(uint64_t);
+    reject->rows = (uint64_t *)arena_alloc(arena, sz ? sz : 1, 64);
+    if (!reject->rows) {
+        fprintf(stderr, "Level arena too small for reject table.\n");
+        return 1;
+    }
+    memset(reject->rows, 0, sz);
+
+    return 0;
+}
+
+/**
+ * Read up to 64 bits of the lump starting at a bit offset; bits past the
+ * end of the lump read as 0.
+ */
+static uint64_t lump_bits(const WadSpan lump, const size_t bit, const unsigned n_bits)
+{
+    uint64_t bits = 0;
+
+    for (unsigned i = 0; i < 9; i++) {
+        const size_t byte = bit / 8 + i;
+        if (byte >= lump.sz || 8 * i >= n_bits + bit % 8)
+            break;
+        const uint64_t b = lump.data[byte];
+        bits |= i ? b << (8 * i - bit % 8) : b >> (bit % 8);
+    }
+
+    return n_bits < 64 ? bits & (((uint64_t)1 << n_bits) - 1) : bits;
+}
+
+bool load_reject(const WadSpan lump, const Map *map, const SectorGraph *graph, ThreadPool *pool, LevelArena *arena, Reject *reject)
+{
+    bool empty = true;
+    for (size_t i = 0; i < lump.sz && empty; i++)
+        empty = !lump.data[i];
+    if (empty)
+        return build_reject(map, graph, pool, arena, reject);
+
+    if (alloc_reject(map, arena, reject))
+        return 1;
+
+    const uint32_t n = reject->n_sectors;
+    for (uint32_t a = 0; a < n; a++) {
+        uint64_t *row = reject->rows + (size_t)a * reject->row_words;
+
+        for (uint32_t word = 0; word < bitset_words(n); word++) {
+            const unsigned n_bits = n - 64 * word < 64 ? n - 64 * word : 64;
+            const uint64_t valid = n_bits < 64 ? ((uint64_t)1 << n_bits) - 1 : ~(uint64_t)0;
+            row[word] = ~lump_bits(lump, (size_t)a * n + 64 * (size_t)word, n_bits) & valid;
+        }
+    }
+
+    return 0;
+}
+
+/* Portals are linedefs crossed in one direction: 2 * line from front to back, 2 * line + 1 back to front. */
+static inline uint32_t portal_line(const uint32_t portal)
+{
+    return portal / 2;
+}
+
+static inline uint32_t portal_target(const Map *map, const uint32_t portal)
+{
+    return portal & 1 ? map->front_sectors[portal / 2] : map->back_sectors[portal / 2];
+}
+
+/**
+ * Check whether a point is on the far side of a portal, or on its line.
+ * The back of a line is on its left, going from start to end.
+ */
+static inline bool past_portal(const Map *map, const uint32_t portal, const int64_t x, const int64_t y)
+{
+    const uint32_t line = portal_line(portal);
+    const int64_t x0 = map->xs[map->starts[line]], y0 = map->ys[map->starts[line]];
+    const int64_t cross = (map->xs[map->ends[line]] - x0) * (y - y0) - (map->ys[map->ends[line]] - y0) * (x - x0);
+
+    return portal & 1 ? cross <= 0 : cross >= 0;
+}
+
+/**
+ * Check whether some of the line of a portal is past another portal.
+ */
+static inline bool portal_past(const Map *map, const uint32_t portal, const uint32_t other)
+{
+    const uint32_t line = portal_line(other);
+
+    return past_portal(map, portal, map->xs[map->starts[line]], map->ys[map->starts[line]])
+        || past_portal(map, portal, map->xs[map->ends[line]], map->ys[map->ends[line]]);
+}
+
+/**
+ * The portal of an edge of the sector graph, leaving a sector.
+ */
+static inline uint32_t edge_portal(const Map *map, const SectorGraph *graph, const uint32_t sector, const uint32_t edge)
+{
+    const uint32_t line = graph->lines[edge];
+    return 2 * line + (map->front_sectors[line] != sector);
+}
+
+/* Sectors [first, end) of the table, and the state shared by every job. */
+typedef struct {
+    const Map *map;
+    const SectorGraph *graph;
+    Reject *reject;
+    uint32_t first, end;
+    bool failed;
+} RejectJob;
+
+/**
+ * Fill the rows of the sectors of a job.
+ */
+static void build_reject_rows(void *arg)
+{
+    RejectJob *job = (RejectJob *)arg;
+    const Map *map = job->map;
+    const SectorGraph *graph = job->graph;
+    const size_t n_portals = 2 * (size_t)map->n_linedefs;
+
+    /* Portals crossed from the current first portal, and the queue to cross from. */
+    uint32_t *stamps = (uint32_t *)calloc(n_portals ? n_portals : 1, sizeof(uint32_t));
+    uint32_t *queue = (uint32_t *)malloc((n_portals ? n_portals : 1) * sizeof(uint32_t));
+    uint32_t stamp = 0;
+    if (!stamps || !queue) {
+        fprintf(stderr, "Failed to allocate memory for reject build.\n");
+        job->failed = true;
+        goto exit_job;
+    }
+
+    for (uint32_t source = job->first; source < job->end; source++) {
+        uint64_t *row = job->reject->rows + (size_t)source * job->reject->row_words;
+        bitset_set(row, source);
+
+        for (uint32_t i = graph->offsets[source]; i < graph->offsets[source + 1]; i++) {
+            const uint32_t first = edge_portal(map, graph, source, i);
+            size_t head = 0, tail = 0;
+
+            stamp++;
+            stamps[first] = stamp;
+            queue[tail++] = first;
+            bitset_set(row, portal_target(map, first));
+
+            while (head < tail) {
+                const uint32_t from = queue[head++];
+                const uint32_t sector = portal_target(map, from);
+
+                for (uint32_t j = graph->offsets[sector]; j < graph->offsets[sector + 1]; j++) {
+                    const uint32_t portal = edge_portal(map, graph, sector, j);
+
+                    if (stamps[portal] == stamp || portal_line(portal) == portal_line(from)
+                            || portal_line(portal) == portal_line(first)
+                            || !portal_past(map, first, portal) || !portal_past(map, from, portal))
+                        continue;
+                    stamps[portal] = stamp;
+                    queue[tail++] = portal;
+                    bitset_set(row, portal_target(map, portal));
+                }
+            }
+        }
+    }
+
+exit_job:
+    free(queue);
+    free(stamps);
+}
+
+bool build_reject(const Map *map, const SectorGraph *graph, ThreadPool *pool, LevelArena *arena, Reject *reject)
+{
+    RejectJob *jobs = NULL;
+    Task *tasks = NULL;
+    bool ret = 1;
+
+    if (alloc_reject(map, arena, reject))
+        return 1;
+
+    const size_t n_jobs = (map->n_sectors + REJECT_JOB_SECTORS - 1) / REJECT_JOB_SECTORS;
+    jobs = (RejectJob *)malloc((n_jobs ? n_jobs : 1) * sizeof(RejectJob));
+    tasks = (Task *)malloc((n_jobs ? n_jobs : 1) * sizeof(Task));
+    if (!jobs || !tasks) {
+        fprintf(stderr, "Failed to allocate memory for reject build.\n");
+        goto exit_build;
+    }
+    for (size_t i = 0; i < n_jobs; i++) {
+        const uint32_t first = (uint32_t)i * REJECT_JOB_SECTORS;
+        jobs[i] = (RejectJob) { map, graph, reject, first,
+            map->n_sectors - first > REJECT_JOB_SECTORS ? first + REJECT_JOB_SECTORS : map->n_sectors, false };
+        tasks[i] = (Task) { build_reject_rows, &jobs[i] };
+    }
+    if (n_jobs && run_tasks(pool, tasks, n_jobs))
+        goto exit_build;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i].failed)
+            goto exit_build;
+    }
+
+    /* Sight goes both ways: keep a pair if either side found it. */
+    for (uint32_t a = 0; a < map->n_sectors; a++) {
+        uint64_t *row = reject->rows + (size_t)a * reject->row_words;
+        for (uint32_t b = a + 1; b < map->n_sectors; b++) {
+            uint64_t *other = reject->rows + (size_t)b * reject->row_words;
+            if (bitset_test(row, b) || bitset_test(other, a)) {
+                bitset_set(row, b);
+                bitset_set(other, a);
+            }
+        }
+    }
+    ret = 0;
+
+exit_build:
+    free(tasks);
+    free(jobs);
+    return ret;
+}
@@ -0,0 +1,104 @@
+#ifndef REJECT_H
+#define REJECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wad.h"
+#include "map.h"
+#include "arena.h"
+#include "bitset.h"
+#include "thread-pool.h"
+#include "sector-graph.h"
+
+/**
+ * Which sectors may see each other. Row a is a bitset of row_words words
+ * starting at rows + a * row_words, 64-byte aligned, with bit b set if a
+ * sector a may see sector b. Bits past n_sectors are clear.
+ *
+ * This is the inverse of the REJECT lump, which sets the bits of pairs
+ * that cannot see each other, so that visible sectors can be iterated.
+ */
+typedef struct {
+    uint64_t *rows;
+    uint32_t n_sectors;
+    uint32_t row_words;
+} Reject;
+
+/**
+ * @brief Load the REJECT lump of a map.
+ *
+ * Short lumps are padded with visible pairs, as the engine does. A
+ * missing or all-zeros lump rejects nothing, so the table is built with
+ * build_reject() instead.
+ *
+ * @param lump Span over the lump, possibly empty.
+ * @param map Pointer to the loaded map.
+ * @param graph Pointer to the sector graph of the map, for building.
+ * @param pool Pointer to the thread pool for building, or NULL.
+ * @param arena Pointer to the arena of the level.
+ * @param reject Pointer where to store the table.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_reject(WadSpan lump, const Map *map, const SectorGraph *graph, ThreadPool *pool, LevelArena *arena, Reject *reject);
+
+/**
+ * @brief Build a reject table from the geometry of a map.
+ *
+ * Sight is followed from each sector through two-sided lines (portals).
+ * A portal is crossed only if it reaches past both the first portal and
+ * the previous one of the path, which every straight line of sight has
+ * to do, so pairs that can see each other are never rejected. Doors are
+ * treated as open. Sectors are split among the threads of the pool.
+ *
+ * @param map Pointer to the loaded map.
+ * @param graph Pointer to the sector graph of the map.
+ * @param pool Pointer to the thread pool, or NULL to run on this thread.
+ * @param arena Pointer to the arena of the level.
+ * @param reject Pointer where to store the table.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_reject(const Map *map, const SectorGraph *graph, ThreadPool *pool, LevelArena *arena, Reject *reject);
+
+/**
+ * @brief Get the row of sectors a sector may see.
+ *
+ * @param reject Pointer to the table.
+ * @param a The sector.
+ * @returns Pointer to the bitset of the row.
+ */
+static inline const uint64_t *reject_row(const Reject *reject, const uint32_t a)
+{
+    return reject->rows + (size_t)a * reject->row_words;
+}
+
+/**
+ * @brief Check whether two sectors may see each other.
+ *
+ * @param reject Pointer to the table.
+ * @param a The sector of the looker.
+ * @param b The sector of the target.
+ * @returns Whether a line of sight between them is possible.
+ */
+static inline bool sectors_can_see(const Reject *reject, const uint32_t a, const uint32_t b)
+{
+    return bitset_test(reject_row(reject, a), b);
+}
+
+/**
+ * @brief Find the next sector a sector may see, a word at a time.
+ *
+ * Loop with b = next_visible_sector(reject, a, 0); b < n_sectors;
+ * b = next_visible_sector(reject, a, b + 1).
+ *
+ * @param reject Pointer to the table.
+ * @param a The sector of the looker.
+ * @param b Sector to start from.
+ * @returns The first visible sector at or after b, or n_sectors.
+ */
+static inline uint32_t next_visible_sector(const Reject *reject, const uint32_t a, const uint32_t b)
+{
+    return (uint32_t)bitset_next(reject_row(reject, a), reject->n_sectors, b);
+}
+
+#endif // REJECT_H
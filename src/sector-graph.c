@@ -0,0 +1,109 @@
+#include "sector-graph.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "bitset.h"
+
+static inline bool is_edge(const Map *map, const uint32_t line)
+{
+    return map->back_sectors[line] != MAP_NO_INDEX && map->back_sectors[line] != map->front_sectors[line];
+}
+
+bool build_sector_graph(SectorGraph *graph, const Map *map, LevelArena *arena)
+{
+    *graph = (SectorGraph) { 0 };
+    graph->n_sectors = map->n_sectors;
+    graph->offsets = (uint32_t *)arena_alloc(arena, ((size_t)map->n_sectors + 1) * sizeof(uint32_t), 64);
+    if (!graph->offsets) {
+        fprintf(stderr, "Level arena too small for sector graph.\n");
+        return 1;
+    }
+    memset(graph->offsets, 0, ((size_t)map->n_sectors + 1) * sizeof(uint32_t));
+
+    /* Count the edges of each sector, then fill them in linedef order. */
+    for (uint32_t i = 0; i < map->n_linedefs; i++) {
+        if (is_edge(map, i)) {
+            graph->offsets[map->front_sectors[i] + 1]++;
+            graph->offsets[map->back_sectors[i] + 1]++;
+        }
+    }
+    for (uint32_t i = 0; i < map->n_sectors; i++)
+        graph->offsets[i + 1] += graph->offsets[i];
+
+    graph->n_edges = graph->offsets[map->n_sectors];
+    graph->neighbors = (uint32_t *)arena_alloc(arena, (graph->n_edges ? graph->n_edges : 1) * sizeof(uint32_t), 64);
+    graph->lines = (uint32_t *)arena_alloc(arena, (graph->n_edges ? graph->n_edges : 1) * sizeof(uint32_t), 64);
+    if (!graph->neighbors || !graph->lines) {
+        fprintf(stderr, "Level arena too small for sector graph.\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < map->n_linedefs; i++) {
+        if (is_edge(map, i)) {
+            const uint32_t front = graph->offsets[map->front_sectors[i]]++;
+            const uint32_t back = graph->offsets[map->back_sectors[i]]++;
+            graph->neighbors[front] = map->back_sectors[i];
+            graph->lines[front] = i;
+            graph->neighbors[back] = map->front_sectors[i];
+            graph->lines[back] = i;
+        }
+    }
+    /* Filling moved each offset to the start of the next sector. */
+    memmove(graph->offsets + 1, graph->offsets, map->n_sectors * sizeof(uint32_t));
+    graph->offsets[0] = 0;
+
+    return 0;
+}
+
+bool init_sector_search(SectorSearch *search, const SectorGraph *graph, LevelArena *arena)
+{
+    const size_t visited_sz = bitset_words(graph->n_sectors) * sizeof(uint64_t);
+
+    search->n_reached = 0;
+    search->visited = (uint64_t *)arena_alloc(arena, visited_sz ? visited_sz : 1, 64);
+    search->order = (uint32_t *)arena_alloc(arena, (graph->n_sectors ? graph->n_sectors : 1) * sizeof(uint32_t), 64);
+    if (!search->visited || !search->order) {
+        fprintf(stderr, "Level arena too small for sector search.\n");
+        return 1;
+    }
+    memset(search->visited, 0, visited_sz);
+
+    return 0;
+}
+
+uint32_t flood_sectors(const SectorGraph *graph, SectorSearch *search, const uint32_t *sources, const uint32_t n_sources,
+        const uint32_t max_depth, SectorEdgeFn fn, void *ctx)
+{
+    /* Forget the last search, touching only what it reached. */
+    for (uint32_t i = 0; i < search->n_reached; i++)
+        bitset_clear(search->visited, search->order[i]);
+
+    uint32_t n_reached = 0;
+    for (uint32_t i = 0; i < n_sources; i++) {
+        if (!bitset_test(search->visited, sources[i])) {
+            bitset_set(search->visited, sources[i]);
+            search->order[n_reached++] = sources[i];
+        }
+    }
+
+    /* order doubles as the queue; each depth is a run of it. */
+    uint32_t head = 0;
+    for (uint32_t depth = 0; depth < max_depth && head < n_reached; depth++) {
+        const uint32_t layer_end = n_reached;
+
+        for (; head < layer_end; head++) {
+            const uint32_t from = search->order[head];
+
+            for (uint32_t e = graph->offsets[from]; e < graph->offsets[from + 1]; e++) {
+                const uint32_t to = graph->neighbors[e];
+                if (bitset_test(search->visited, to) || (fn && !fn(from, to, graph->lines[e], ctx)))
+                    continue;
+                bitset_set(search->visited, to);
+                search->order[n_reached++] = to;
+            }
+        }
+    }
+
+    search->n_reached = n_reached;
+    return n_reached;
+}
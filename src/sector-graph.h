@@ -0,0 +1,85 @@
+#ifndef SECTOR_GRAPH_H
+#define SECTOR_GRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "arena.h"
+
+/* Depth given to flood_sectors() for no limit. */
+#define SECTOR_NO_DEPTH_LIMIT UINT32_MAX
+
+/**
+ * Which sectors touch each other, in compressed sparse row form. The
+ * edges of sector s are [offsets[s], offsets[s + 1]): neighbors[e] is the
+ * sector across linedef lines[e]. There is one edge per two-sided line
+ * between different sectors, in each direction, in linedef order.
+ */
+typedef struct {
+    uint32_t n_sectors, n_edges;
+    uint32_t *offsets;
+    uint32_t *neighbors;
+    uint32_t *lines;
+} SectorGraph;
+
+/**
+ * Scratch for searches over the graph, owned by one thread and reused
+ * from one search to the next. After a search, visited has the bit of
+ * every sector reached, and order lists them in the order they were
+ * reached; only those bits are cleared by the next search.
+ */
+typedef struct {
+    uint64_t *visited;
+    uint32_t *order;
+    uint32_t n_reached;
+} SectorSearch;
+
+/**
+ * Decide whether a search crosses an edge.
+ *
+ * @param from The sector the search is in.
+ * @param to The sector across the edge.
+ * @param line The linedef of the edge.
+ * @param ctx Pointer given to the search.
+ * @returns 1 to cross the edge, 0 to skip it.
+ */
+typedef bool (*SectorEdgeFn)(uint32_t from, uint32_t to, uint32_t line, void *ctx);
+
+/**
+ * @brief Build the adjacency of the sectors of a map.
+ *
+ * @param graph Pointer where to store the graph.
+ * @param map Pointer to the loaded map.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_sector_graph(SectorGraph *graph, const Map *map, LevelArena *arena);
+
+/**
+ * @brief Allocate the scratch of a thread for searches.
+ *
+ * @param search Pointer where to store the scratch.
+ * @param graph Pointer to the graph.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool init_sector_search(SectorSearch *search, const SectorGraph *graph, LevelArena *arena);
+
+/**
+ * @brief Reach sectors breadth first from a set of sectors.
+ *
+ * @param graph Pointer to the graph.
+ * @param search Pointer to the scratch of the calling thread.
+ * @param sources Array of sectors to start from.
+ * @param n_sources Number of sectors to start from.
+ * @param max_depth Number of edges to cross at most, or
+ *                  SECTOR_NO_DEPTH_LIMIT.
+ * @param fn Function deciding which edges to cross, or NULL for all.
+ * @param ctx Pointer passed to fn.
+ * @returns Number of sectors reached, sources included.
+ */
+uint32_t flood_sectors(const SectorGraph *graph, SectorSearch *search, const uint32_t *sources, uint32_t n_sources,
+        uint32_t max_depth, SectorEdgeFn fn, void *ctx);
+
+#endif // SECTOR_GRAPH_H
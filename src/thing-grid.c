@@ -0,0 +1,237 @@
+#include "thing-grid.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/* Arrays start on cache line boundaries. */
+#define THING_ALIGN 64
+
+static inline size_t align_up(const size_t x)
+{
+    return (x + THING_ALIGN - 1) & ~(size_t)(THING_ALIGN - 1);
+}
+
+static inline uint32_t outside_cell(const ThingGrid *grid)
+{
+    return grid->width * grid->height;
+}
+
+/**
+ * Find the cell holding a point, or the list of things outside the grid.
+ */
+static uint32_t thing_cell(const ThingGrid *grid, const float x, const float y)
+{
+    const float cx = (x - (float)grid->origin_x) / BLOCKMAP_CELL;
+    const float cy = (y - (float)grid->origin_y) / BLOCKMAP_CELL;
+
+    /* Written so that NaN lands outside too. */
+    if (!(cx >= 0.0f && cx < (float)grid->width && cy >= 0.0f && cy < (float)grid->height))
+        return outside_cell(grid);
+    return (uint32_t)cy * grid->width + (uint32_t)cx;
+}
+
+static void link_thing(ThingGrid *grid, const uint32_t thing, const uint32_t cell)
+{
+    const uint32_t head = grid->heads[cell];
+
+    grid->prev[thing] = THING_NONE;
+    grid->next[thing] = head;
+    if (head != THING_NONE)
+        grid->prev[head] = thing;
+    grid->heads[cell] = thing;
+    grid->cells[thing] = cell;
+}
+
+static void unlink_thing(ThingGrid *grid, const uint32_t thing)
+{
+    const uint32_t prev = grid->prev[thing], next = grid->next[thing];
+
+    if (prev != THING_NONE)
+        grid->next[prev] = next;
+    else
+        grid->heads[grid->cells[thing]] = next;
+    if (next != THING_NONE)
+        grid->prev[next] = prev;
+}
+
+bool load_thing_grid(ThingGrid *grid, const Map *map, const Blockmap *blockmap, const uint32_t capacity, LevelArena *arena)
+{
+    if (capacity < map->n_things) {
+        fprintf(stderr, "Room for %u things is too small for %u map things.\n", capacity, map->n_things);
+        return 1;
+    }
+
+    const size_t n_heads = (size_t)blockmap->width * blockmap->height + 1;
+    const size_t field_sz = align_up((size_t)capacity * sizeof(uint32_t));
+    const size_t half_sz = align_up((size_t)capacity * sizeof(uint16_t));
+    const size_t heads_sz = align_up(n_heads * sizeof(uint32_t));
+    const size_t total = 6 * field_sz + 3 * half_sz + heads_sz;
+
+    uint8_t *p = (uint8_t *)arena_alloc(arena, total, THING_ALIGN);
+    if (!p) {
+        fprintf(stderr, "Level arena too small for things.\n");
+        return 1;
+    }
+
+    *grid = (ThingGrid) { 0 };
+    grid->capacity = capacity;
+    grid->xs = (float *)p;              p += field_sz;
+    grid->ys = (float *)p;              p += field_sz;
+    grid->radii = (float *)p;           p += field_sz;
+    grid->cells = (uint32_t *)p;        p += field_sz;
+    grid->next = (uint32_t *)p;         p += field_sz;
+    grid->prev = (uint32_t *)p;         p += field_sz;
+    grid->angles = (int16_t *)p;        p += half_sz;
+    grid->types = (uint16_t *)p;        p += half_sz;
+    grid->flags = (uint16_t *)p;        p += half_sz;
+    grid->heads = (uint32_t *)p;
+
+    grid->origin_x = blockmap->origin_x;
+    grid->origin_y = blockmap->origin_y;
+    grid->width = blockmap->width;
+    grid->height = blockmap->height;
+    for (size_t i = 0; i < n_heads; i++)
+        grid->heads[i] = THING_NONE;
+
+    /* Chain every slot past the map things as free, in order. */
+    grid->free_head = THING_NONE;
+    for (uint32_t i = capacity; i-- > map->n_things;) {
+        grid->cells[i] = THING_NONE;
+        grid->next[i] = grid->free_head;
+        grid->free_head = i;
+    }
+
+    for (uint32_t i = 0; i < map->n_things; i++) {
+        grid->xs[i] = map->things[i].x;
+        grid->ys[i] = map->things[i].y;
+        grid->radii[i] = THING_DEFAULT_RADIUS;
+        grid->angles[i] = map->things[i].angle;
+        grid->types[i] = map->things[i].type;
+        grid->flags[i] = map->things[i].flags;
+        link_thing(grid, i, thing_cell(grid, grid->xs[i], grid->ys[i]));
+    }
+    grid->n_things = map->n_things;
+    grid->max_radius = map->n_things ? THING_DEFAULT_RADIUS : 0.0f;
+
+    return 0;
+}
+
+uint32_t spawn_thing(ThingGrid *grid, const float x, const float y, const float radius)
+{
+    const uint32_t thing = grid->free_head;
+    if (thing == THING_NONE)
+        return THING_NONE;
+    grid->free_head = grid->next[thing];
+
+    grid->xs[thing] = x;
+    grid->ys[thing] = y;
+    grid->radii[thing] = radius;
+    grid->angles[thing] = 0;
+    grid->types[thing] = 0;
+    grid->flags[thing] = 0;
+    grid->max_radius = radius > grid->max_radius ? radius : grid->max_radius;
+    link_thing(grid, thing, thing_cell(grid, x, y));
+    grid->n_things++;
+
+    return thing;
+}
+
+void remove_thing(ThingGrid *grid, const uint32_t thing)
+{
+    unlink_thing(grid, thing);
+    grid->cells[thing] = THING_NONE;
+    grid->next[thing] = grid->free_head;
+    grid->free_head = thing;
+    grid->n_things--;
+}
+
+void move_thing(ThingGrid *grid, const uint32_t thing, const float x, const float y)
+{
+    const uint32_t cell = thing_cell(grid, x, y);
+
+    grid->xs[thing] = x;
+    grid->ys[thing] = y;
+    if (cell != grid->cells[thing]) {
+        unlink_thing(grid, thing);
+        link_thing(grid, thing, cell);
+    }
+}
+
+/* Test of a thing against a query. */
+typedef bool (*ThingTest)(const ThingGrid *grid, uint32_t thing, const float *query);
+
+/**
+ * Visit the things of every cell whose things may overlap a box, widened
+ * by the largest radius, passing those that pass the test to fn. The link
+ * to the next thing is read before fn runs, so fn may unlink the thing.
+ */
+static bool visit_cells(const ThingGrid *grid, const float *box, ThingTest test, const float *query, ThingFn fn, void *ctx)
+{
+    const float x0 = floorf((box[0] - grid->max_radius - (float)grid->origin_x) / BLOCKMAP_CELL);
+    const float y0 = floorf((box[1] - grid->max_radius - (float)grid->origin_y) / BLOCKMAP_CELL);
+    const float x1 = floorf((box[2] + grid->max_radius - (float)grid->origin_x) / BLOCKMAP_CELL);
+    const float y1 = floorf((box[3] + grid->max_radius - (float)grid->origin_y) / BLOCKMAP_CELL);
+
+    if (!(x0 <= x1 && y0 <= y1))
+        return 0;
+
+    /* The outside list is only looked at by queries reaching past the grid. */
+    if (x0 < 0.0f || y0 < 0.0f || x1 >= (float)grid->width || y1 >= (float)grid->height) {
+        for (uint32_t t = grid->heads[outside_cell(grid)], next; t != THING_NONE; t = next) {
+            next = grid->next[t];
+            if (test(grid, t, query) && fn(t, ctx))
+                return 1;
+        }
+    }
+    if (x1 < 0.0f || y1 < 0.0f || x0 >= (float)grid->width || y0 >= (float)grid->height)
+        return 0;
+
+    const uint32_t cx0 = x0 < 0.0f ? 0 : (uint32_t)x0;
+    const uint32_t cy0 = y0 < 0.0f ? 0 : (uint32_t)y0;
+    const uint32_t cx1 = x1 >= (float)grid->width ? grid->width - 1 : (uint32_t)x1;
+    const uint32_t cy1 = y1 >= (float)grid->height ? grid->height - 1 : (uint32_t)y1;
+
+    for (uint32_t cy = cy0; cy <= cy1; cy++) {
+        for (uint32_t cx = cx0; cx <= cx1; cx++) {
+            for (uint32_t t = grid->heads[cy * grid->width + cx], next; t != THING_NONE; t = next) {
+                next = grid->next[t];
+                if (test(grid, t, query) && fn(t, ctx))
+                    return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* query: x, y, radius */
+static bool touches_circle(const ThingGrid *grid, const uint32_t thing, const float *query)
+{
+    const float dx = grid->xs[thing] - query[0], dy = grid->ys[thing] - query[1];
+    const float reach = query[2] + grid->radii[thing];
+    return dx * dx + dy * dy <= reach * reach;
+}
+
+/* query: left, bottom, right, top */
+static bool touches_box(const ThingGrid *grid, const uint32_t thing, const float *query)
+{
+    const float x = grid->xs[thing], y = grid->ys[thing], radius = grid->radii[thing];
+    return x + radius >= query[0] && y + radius >= query[1] && x - radius <= query[2] && y - radius <= query[3];
+}
+
+bool things_in_radius(const ThingGrid *grid, const float x, const float y, const float radius, ThingFn fn, void *ctx)
+{
+    const float box[4] = { x - radius, y - radius, x + radius, y + radius };
+    const float query[3] = { x, y, radius };
+
+    return visit_cells(grid, box, touches_circle, query, fn, ctx);
+}
+
+bool things_in_box(const ThingGrid *grid, const float left, const float bottom, const float right, const float top,
+        ThingFn fn, void *ctx)
+{
+    const float box[4] = { left, bottom, right, top };
+
+    return visit_cells(grid, box, touches_box, box, fn, ctx);
+}
@@ -0,0 +1,146 @@
+#ifndef THING_GRID_H
+#define THING_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "map.h"
+#include "blockmap.h"
+#include "arena.h"
+
+/* No thing: end of a list, or no room left. */
+#define THING_NONE UINT32_MAX
+
+/* Radius given to things loaded from the map, in map units. */
+#define THING_DEFAULT_RADIUS 20.0f
+
+/**
+ * Live things of a level, one array per field, linked into a grid with the
+ * cells of the blockmap. Each cell heads a doubly linked list threaded
+ * through next and prev, so inserting, removing and moving a thing take
+ * constant time. Things outside the grid go in one extra list after the
+ * last cell. Slots of removed things are reused, and capacity is fixed
+ * when the level is loaded.
+ */
+typedef struct {
+    uint32_t n_things, capacity;
+
+    /**
+     * Position and radius.
+     */
+    float *xs, *ys, *radii;
+
+    /**
+     * Fields from the THINGS lump.
+     */
+    int16_t *angles;
+    uint16_t *types, *flags;
+
+    /**
+     * Cell holding each thing, THING_NONE for free slots. The links of
+     * free slots chain them through next, from free_head.
+     */
+    uint32_t *cells;
+    uint32_t *next, *prev;
+    uint32_t free_head;
+
+    /**
+     * Grid, with width * height + 1 list heads.
+     */
+    int32_t origin_x, origin_y;
+    uint32_t width, height;
+    uint32_t *heads;
+
+    /**
+     * Largest radius of any thing ever linked, which widens queries
+     * enough to find things whose center is in a neighbouring cell.
+     */
+    float max_radius;
+} ThingGrid;
+
+/**
+ * Called once for each thing found by a query.
+ *
+ * The function may remove or move the thing it is given, and spawn new
+ * things, but must not remove or move any other thing while the query
+ * runs. Spawned things may or may not be visited, and a thing moved into
+ * a cell the query has not reached yet may be visited again.
+ *
+ * @param thing Index of the thing.
+ * @param ctx Pointer given to the query.
+ * @returns 0 to continue, 1 to stop the query.
+ */
+typedef bool (*ThingFn)(uint32_t thing, void *ctx);
+
+/**
+ * @brief Create the things of a map and link them into a grid.
+ *
+ * @param grid Pointer where to store the grid.
+ * @param map Pointer to the loaded map.
+ * @param blockmap Pointer to the blockmap, whose cells the grid uses.
+ * @param capacity Number of things the level can hold, at least
+ *                 n_things of the map.
+ * @param arena Pointer to the arena of the level.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_thing_grid(ThingGrid *grid, const Map *map, const Blockmap *blockmap, uint32_t capacity, LevelArena *arena);
+
+/**
+ * @brief Add a thing.
+ *
+ * Other fields are zeroed.
+ *
+ * @param grid Pointer to the grid.
+ * @param x X coordinate.
+ * @param y Y coordinate.
+ * @param radius Radius.
+ * @returns Index of the thing, or THING_NONE if the grid is full.
+ */
+uint32_t spawn_thing(ThingGrid *grid, float x, float y, float radius);
+
+/**
+ * @brief Remove a thing, freeing its slot.
+ *
+ * @param grid Pointer to the grid.
+ * @param thing Index of the thing.
+ */
+void remove_thing(ThingGrid *grid, uint32_t thing);
+
+/**
+ * @brief Move a thing, relinking it if it changes cell.
+ *
+ * @param grid Pointer to the grid.
+ * @param thing Index of the thing.
+ * @param x New x coordinate.
+ * @param y New y coordinate.
+ */
+void move_thing(ThingGrid *grid, uint32_t thing, float x, float y);
+
+/**
+ * @brief Visit every thing touching a circle.
+ *
+ * @param grid Pointer to the grid.
+ * @param x X coordinate of the center.
+ * @param y Y coordinate of the center.
+ * @param radius Radius of the circle.
+ * @param fn Function called for each thing.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the query, 0 otherwise.
+ */
+bool things_in_radius(const ThingGrid *grid, float x, float y, float radius, ThingFn fn, void *ctx);
+
+/**
+ * @brief Visit every thing whose bounding box overlaps a box.
+ *
+ * @param grid Pointer to the grid.
+ * @param left Smallest x of the box.
+ * @param bottom Smallest y of the box.
+ * @param right Largest x of the box.
+ * @param top Largest y of the box.
+ * @param fn Function called for each thing.
+ * @param ctx Pointer passed to fn.
+ * @returns 1 if fn stopped the query, 0 otherwise.
+ */
+bool things_in_box(const ThingGrid *grid, float left, float bottom, float right, float top, ThingFn fn, void *ctx);
+
+#endif // THING_GRID_H
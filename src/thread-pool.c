@@ -0,0 +1,169 @@
+#include "thread-pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* Tasks of one run_tasks() call that have not finished yet. */
+struct task_batch {
+    size_t remaining;
+};
+
+static size_t count_cpus(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+/**
+ * Take the next task off the queue. Must be called with the lock held.
+ */
+static QueuedTask pop_task(ThreadPool *pool)
+{
+    const QueuedTask queued = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->count--;
+    return queued;
+}
+
+/**
+ * Run a task with the lock released, then account for it.
+ */
+static void finish_task(ThreadPool *pool, const QueuedTask queued)
+{
+    pthread_mutex_unlock(&pool->lock);
+    queued.task.fn(queued.task.arg);
+    pthread_mutex_lock(&pool->lock);
+
+    if (!--queued.batch->remaining)
+        pthread_cond_broadcast(&pool->done);
+}
+
+static void *worker(void *arg)
+{
+    ThreadPool *pool = (ThreadPool *)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->count && !pool->stop)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (!pool->count)
+            break;
+        finish_task(pool, pop_task(pool));
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+bool create_thread_pool(ThreadPool *pool, size_t n_threads)
+{
+    if (!pool) {
+        fprintf(stderr, "Cannot create thread pool into null pointer.\n");
+        return 1;
+    }
+    if (!n_threads)
+        n_threads = count_cpus() - 1;
+
+    *pool = (ThreadPool) { 0 };
+    pool->capacity = 64;
+    pool->queue = (QueuedTask *)malloc(pool->capacity * sizeof(QueuedTask));
+    pool->threads = (pthread_t *)malloc((n_threads ? n_threads : 1) * sizeof(pthread_t));
+    if (!pool->queue || !pool->threads) {
+        fprintf(stderr, "Failed to allocate memory for thread pool.\n");
+        free(pool->queue);
+        free(pool->threads);
+        return 1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (size_t i = 0; i < n_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool)) {
+            fprintf(stderr, "Failed to start worker thread.\n");
+            break;
+        }
+        pool->n_threads++;
+    }
+
+    return 0;
+}
+
+void destroy_thread_pool(ThreadPool *pool)
+{
+    if (!pool || !pool->queue)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->n_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->queue);
+    *pool = (ThreadPool) { 0 };
+}
+
+bool run_tasks(ThreadPool *pool, const Task *tasks, const size_t n_tasks)
+{
+    if (!pool || !pool->n_threads) {
+        for (size_t i = 0; i < n_tasks; i++)
+            tasks[i].fn(tasks[i].arg);
+        return 0;
+    }
+
+    struct task_batch batch = { n_tasks };
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count + n_tasks > pool->capacity) {
+        size_t capacity = pool->capacity;
+        while (capacity < pool->count + n_tasks)
+            capacity *= 2;
+
+        QueuedTask *queue = (QueuedTask *)malloc(capacity * sizeof(QueuedTask));
+        if (!queue) {
+            pthread_mutex_unlock(&pool->lock);
+            fprintf(stderr, "Failed to allocate memory for task queue.\n");
+            return 1;
+        }
+        for (size_t i = 0; i < pool->count; i++)
+            queue[i] = pool->queue[(pool->head + i) % pool->capacity];
+        free(pool->queue);
+        pool->queue = queue;
+        pool->capacity = capacity;
+        pool->head = 0;
+    }
+
+    for (size_t i = 0; i < n_tasks; i++)
+        pool->queue[(pool->head + pool->count++) % pool->capacity] = (QueuedTask) { tasks[i], &batch };
+    pthread_cond_broadcast(&pool->work);
+
+    /* Help with queued tasks, which may belong to other batches, until ours are done. */
+    while (batch.remaining) {
+        if (pool->count)
+            finish_task(pool, pop_task(pool));
+        else
+            pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
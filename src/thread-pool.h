@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* A unit of work: fn(arg). */
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+} Task;
+
+struct task_batch;
+
+/* Slot of the task queue. */
+typedef struct {
+    Task task;
+    struct task_batch *batch;
+} QueuedTask;
+
+/* A small fixed set of worker threads sharing one task queue. */
+typedef struct {
+    pthread_t *threads;
+    size_t n_threads;
+
+    /**
+     * Ring buffer of tasks waiting for a thread, guarded by lock. Workers
+     * sleep on work; callers of run_tasks() sleep on done.
+     */
+    QueuedTask *queue;
+    size_t head, count, capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    bool stop;
+} ThreadPool;
+
+/**
+ * @brief Start the worker threads of a pool.
+ *
+ * @param pool Pointer where to store the pool.
+ * @param n_threads Number of workers, or 0 for one per CPU besides the
+ *                  calling thread.
+ * @returns 0 on success, 1 on failure.
+ */
+bool create_thread_pool(ThreadPool *pool, size_t n_threads);
+
+/**
+ * @brief Stop and join the worker threads of a pool.
+ *
+ * @param pool Pointer to the pool.
+ */
+void destroy_thread_pool(ThreadPool *pool);
+
+/**
+ * @brief Run tasks on the pool and wait for all of them.
+ *
+ * The calling thread runs queued tasks too while it waits, so a pool with
+ * no workers (or a NULL pool) runs everything serially.
+ *
+ * @param pool Pointer to the pool, or NULL.
+ * @param tasks Array of tasks.
+ * @param n_tasks Number of tasks.
+ * @returns 0 on success, 1 if the tasks could not be queued.
+ */
+bool run_tasks(ThreadPool *pool, const Task *tasks, size_t n_tasks);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,215 @@
+#include "wad-index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline uint32_t hash_key(uint64_t key, const uint32_t capacity)
+{
+    /*
+     * Names differ mostly in their last characters, which are the high
+     * bytes of the key: fold them down before multiplying.
+     */
+    key ^= key >> 33;
+    key *= 0x9E3779B97F4A7C15ull;
+    key ^= key >> 29;
+    return (uint32_t)key & (capacity - 1);
+}
+
+uint64_t pack_lump_name(const char *name)
+{
+    uint64_t key = 0;
+
+    for (size_t i = 0; i < 8 && name[i]; i++) {
+        uint8_t c = (uint8_t)name[i];
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        key |= (uint64_t)c << (8 * i);
+    }
+
+    return key;
+}
+
+uint64_t pack_name_bytes(const uint8_t *bytes)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    uint64_t key = 0;
+
+    for (size_t i = 0; i < 8; i++)
+        key |= (uint64_t)bytes[i] << (8 * i);
+
+    /* Drop everything from the first null byte on. */
+    const uint64_t zeros = (key - ones) & ~key & highs;
+    if (zeros)
+        key &= ((zeros & -zeros) >> 7) - 1;
+
+    /* Upper-case bytes in 'a'..'z' (ASCII bytes only), all at once. */
+    const uint64_t low7 = key & ~highs;
+    const uint64_t at_least_a = low7 + (0x80 - 'a') * ones;
+    const uint64_t above_z = low7 + (0x80 - 'z' - 1) * ones;
+    key ^= (at_least_a & ~above_z & ~key & highs) >> 2;
+
+    return key;
+}
+
+void unpack_lump_name(uint64_t key, char name[9])
+{
+    for (size_t i = 0; i < 8; i++) {
+        name[i] = (char)(key & 0xFF);
+        key >>= 8;
+    }
+    name[8] = '\0';
+}
+
+bool build_wad_index(const WAD *wad, const Header *header, WadIndex *index)
+{
+    return build_merged_wad_index(wad, header, 1, index);
+}
+
+bool build_merged_wad_index(const WAD *wads, const Header *headers, const size_t n_wads, WadIndex *index)
+{
+    /* Check for null pointers. */
+    if (!wads || !headers) {
+        fprintf(stderr, "Cannot index unloaded WAD or null pointer.\n");
+        return 1;
+    }
+
+    WadSpan *directories = (WadSpan *)malloc((n_wads ? n_wads : 1) * sizeof(WadSpan));
+    size_t *file_sizes = (size_t *)malloc((n_wads ? n_wads : 1) * sizeof(size_t));
+    bool ret = 0;
+    if (!directories || !file_sizes) {
+        fprintf(stderr, "Failed to allocate memory for WAD index.\n");
+        ret = 1;
+        goto exit_build;
+    }
+
+    /* Check that the whole directory of every WAD lies inside it, once. */
+    for (size_t file = 0; file < n_wads; file++) {
+        const WadError err = wad_span_records(&wads[file], headers[file].listing_offset,
+                headers[file].num_directories, WAD_DIRECTORY_SIZE, &directories[file]);
+        if (err) {
+            fprintf(stderr, "Could not index WAD directory: %s.\n", wad_strerror(err));
+            ret = 1;
+            goto exit_build;
+        }
+        file_sizes[file] = wads[file].sz;
+    }
+
+    ret = build_wad_index_from_directories(directories, file_sizes, n_wads, index);
+
+exit_build:
+    free(directories);
+    free(file_sizes);
+    return ret;
+}
+
+bool build_wad_index_from_directories(const WadSpan *directories, const size_t *file_sizes,
+        const size_t n_files, WadIndex *index)
+{
+    /* Check for null pointers. */
+    if (!directories || !file_sizes) {
+        fprintf(stderr, "Cannot index null directories.\n");
+        return 1;
+    }
+    if (!index) {
+        fprintf(stderr, "Cannot store index into null pointer.\n");
+        return 1;
+    }
+
+    size_t n = 0;
+    for (size_t file = 0; file < n_files; file++)
+        n += directories[file].sz / WAD_DIRECTORY_SIZE;
+    if (n >= WAD_NO_LUMP) {
+        fprintf(stderr, "Too many lumps to index.\n");
+        return 1;
+    }
+
+    /* Keep the table at most half full. */
+    uint32_t capacity = 16;
+    while (capacity < 2 * n)
+        capacity <<= 1;
+
+    index->n_lumps = (uint32_t)n;
+    index->capacity = capacity;
+    index->lumps = (WadLump *)malloc((n ? n : 1) * sizeof(WadLump));
+    index->slots = (WadIndexSlot *)malloc(capacity * sizeof(WadIndexSlot));
+    if (!index->lumps || !index->slots) {
+        fprintf(stderr, "Failed to allocate memory for WAD index.\n");
+        free_wad_index(index);
+        return 1;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        index->slots[i].key = 0;
+        index->slots[i].lump = WAD_NO_LUMP;
+    }
+
+    uint32_t i = 0;
+    for (size_t file = 0; file < n_files; file++) {
+        const WadSpan span = directories[file];
+        const size_t file_sz = file_sizes[file];
+
+        for (size_t entry = 0; entry + WAD_DIRECTORY_SIZE <= span.sz; entry += WAD_DIRECTORY_SIZE, i++) {
+            WadLump *lump = &index->lumps[i];
+
+            lump->lump_offset = span_u32(span, entry);
+            lump->lump_size = span_u32(span, entry + 4);
+            lump->name = pack_name_bytes(span.data + entry + 8);
+            lump->file = (uint32_t)file;
+
+            /* Check that the lump lies inside its WAD. */
+            if (lump->lump_offset > file_sz || lump->lump_size > file_sz - lump->lump_offset) {
+                fprintf(stderr, "WAD lump %u extends beyond WAD size.\n", i);
+                free_wad_index(index);
+                return 1;
+            }
+
+            /* Insert, or replace the earlier lump with the same name. */
+            uint32_t slot = hash_key(lump->name, capacity);
+            while (index->slots[slot].lump != WAD_NO_LUMP && index->slots[slot].key != lump->name)
+                slot = (slot + 1) & (capacity - 1);
+            index->slots[slot].key = lump->name;
+            index->slots[slot].lump = i;
+        }
+    }
+
+    return 0;
+}
+
+void free_wad_index(WadIndex *index)
+{
+    if (!index)
+        return;
+
+    free(index->lumps);
+    free(index->slots);
+    index->lumps = NULL;
+    index->slots = NULL;
+    index->n_lumps = 0;
+    index->capacity = 0;
+}
+
+uint32_t find_lump_num(const WadIndex *index, const uint64_t key)
+{
+    uint32_t slot = hash_key(key, index->capacity);
+
+    while (index->slots[slot].lump != WAD_NO_LUMP) {
+        if (index->slots[slot].key == key)
+            return index->slots[slot].lump;
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+
+    return WAD_NO_LUMP;
+}
+
+bool find_lump(const WadIndex *index, const char *name, Directory *directory)
+{
+    const uint32_t lump = find_lump_num(index, pack_lump_name(name));
+    if (lump == WAD_NO_LUMP)
+        return 1;
+
+    directory->lump_offset = index->lumps[lump].lump_offset;
+    directory->lump_size = index->lumps[lump].lump_size;
+    unpack_lump_name(index->lumps[lump].name, directory->lump_name);
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#ifndef WAD_INDEX_H
+#define WAD_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wad.h"
+
+/* Lump number returned when a name is not in the index. */
+#define WAD_NO_LUMP UINT32_MAX
+
+/* Directory entry, with the lump name packed into a 64-bit key. */
+typedef struct {
+    uint64_t name;
+    uint32_t lump_offset;
+    uint32_t lump_size;
+    uint32_t file; /* which of the indexed WADs holds the lump */
+} WadLump;
+
+/* Hash table slot. */
+typedef struct {
+    uint64_t key;
+    uint32_t lump;
+} WadIndexSlot;
+
+/* Index of every lump of a WAD, by name. */
+typedef struct {
+    /**
+     * Every directory entry, in directory order. A lump number is an
+     * index into this array.
+     */
+    WadLump *lumps;
+    uint32_t n_lumps;
+
+    /**
+     * Open addressing hash table from packed name to the number of the
+     * last lump with that name. Empty slots hold WAD_NO_LUMP.
+     */
+    WadIndexSlot *slots;
+    uint32_t capacity;
+} WadIndex;
+
+/**
+ * @brief Pack a lump name into a 64-bit key.
+ *
+ * Names are upper-cased, like the engine does when looking them up, and
+ * end at the first null byte or after 8 characters.
+ *
+ * @param name The lump name.
+ * @returns The packed name.
+ */
+uint64_t pack_lump_name(const char *name);
+
+/**
+ * @brief Pack an 8-byte name field, as stored in WAD records, into a
+ *        64-bit key.
+ *
+ * Same result as pack_lump_name(), but works on the whole field at once
+ * instead of a byte at a time.
+ *
+ * @param bytes The 8 bytes of the name, not necessarily null-terminated.
+ * @returns The packed name.
+ */
+uint64_t pack_name_bytes(const uint8_t *bytes);
+
+/**
+ * @brief Unpack a 64-bit key into a null-terminated lump name.
+ *
+ * @param key The packed name.
+ * @param name Buffer where to store the name.
+ */
+void unpack_lump_name(uint64_t key, char name[9]);
+
+/**
+ * @brief Build the index of a loaded WAD in one pass over its directory.
+ *
+ * When several lumps share a name, the last one wins.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param header Pointer to the header of the WAD.
+ * @param index Pointer where to store the index.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_wad_index(const WAD *wad, const Header *header, WadIndex *index);
+
+/**
+ * @brief Build one merged index over several loaded WADs.
+ *
+ * Directories are appended in order, so lumps of later WADs override
+ * lumps of earlier WADs with the same name, and the hash table is only
+ * built once.
+ *
+ * @param wads Array of loaded WADs.
+ * @param headers Array of the headers of the WADs.
+ * @param n_wads Number of WADs.
+ * @param index Pointer where to store the index.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_merged_wad_index(const WAD *wads, const Header *headers, size_t n_wads, WadIndex *index);
+
+/**
+ * @brief Build one merged index from raw directories, without the WADs.
+ *
+ * For WADs that are not loaded in memory: each directory is the
+ * num_directories * 16 bytes read from the listing offset.
+ *
+ * @param directories Array of spans over the directory of each WAD.
+ * @param file_sizes Array of the sizes of the WAD files, to check lumps.
+ * @param n_files Number of WADs.
+ * @param index Pointer where to store the index.
+ * @returns 0 on success, 1 on failure.
+ */
+bool build_wad_index_from_directories(const WadSpan *directories, const size_t *file_sizes,
+        size_t n_files, WadIndex *index);
+
+/**
+ * @brief Free the memory held by an index.
+ *
+ * @param index Pointer to the index.
+ */
+void free_wad_index(WadIndex *index);
+
+/**
+ * @brief Find the number of the last lump with the given packed name.
+ *
+ * @param index Pointer to the index.
+ * @param key The packed lump name.
+ * @returns The lump number, or WAD_NO_LUMP if there is no such lump.
+ */
+uint32_t find_lump_num(const WadIndex *index, uint64_t key);
+
+/**
+ * @brief Find the directory entry of the last lump with the given name.
+ *
+ * @param index Pointer to the index.
+ * @param name The lump name.
+ * @param directory Pointer where to store the directory entry.
+ * @returns 0 on success, 1 if there is no such lump.
+ */
+bool find_lump(const WadIndex *index, const char *name, Directory *directory);
+
+#endif // WAD_INDEX_H
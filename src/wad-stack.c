@@ -0,0 +1,80 @@
+#include "wad-stack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool open_wad_stack(WadStack *stack, const char *const *paths, const size_t n_paths, const bool mapped)
+{
+    /* Check for null pointers. */
+    if (!stack || (!paths && n_paths)) {
+        fprintf(stderr, "Cannot open WAD stack from or into null pointer.\n");
+        return 1;
+    }
+
+    stack->n_wads = 0;
+    stack->index = (WadIndex) { 0 };
+    stack->wads = (WAD *)calloc(n_paths ? n_paths : 1, sizeof(WAD));
+    stack->headers = (Header *)calloc(n_paths ? n_paths : 1, sizeof(Header));
+    if (!stack->wads || !stack->headers) {
+        fprintf(stderr, "Failed to allocate memory for WAD stack.\n");
+        close_wad_stack(stack);
+        return 1;
+    }
+
+    for (size_t i = 0; i < n_paths; i++) {
+        const bool failed = mapped
+            ? load_wad_mapped(paths[i], &stack->wads[i])
+            : load_wad(paths[i], &stack->wads[i]);
+        if (failed) {
+            close_wad_stack(stack);
+            return 1;
+        }
+        stack->n_wads++;
+
+        if (load_header(&stack->wads[i], &stack->headers[i])) {
+            fprintf(stderr, "Invalid WAD in stack: %s\n", paths[i]);
+            close_wad_stack(stack);
+            return 1;
+        }
+    }
+
+    if (build_merged_wad_index(stack->wads, stack->headers, stack->n_wads, &stack->index)) {
+        close_wad_stack(stack);
+        return 1;
+    }
+
+    return 0;
+}
+
+void close_wad_stack(WadStack *stack)
+{
+    if (!stack)
+        return;
+
+    free_wad_index(&stack->index);
+    for (size_t i = 0; i < stack->n_wads; i++)
+        unload_wad(&stack->wads[i]);
+    free(stack->wads);
+    free(stack->headers);
+    stack->wads = NULL;
+    stack->headers = NULL;
+    stack->n_wads = 0;
+}
+
+bool wad_stack_lump_num(const WadStack *stack, const uint32_t lump, WadSpan *span)
+{
+    if (lump >= stack->index.n_lumps)
+        return 1;
+
+    /* The index has already checked that the lump lies inside its WAD. */
+    const WadLump *l = &stack->index.lumps[lump];
+    span->data = stack->wads[l->file].data + l->lump_offset;
+    span->sz = l->lump_size;
+
+    return 0;
+}
+
+bool wad_stack_lump(const WadStack *stack, const char *name, WadSpan *span)
+{
+    return wad_stack_lump_num(stack, find_lump_num(&stack->index, pack_lump_name(name)), span);
+}
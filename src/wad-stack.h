@@ -0,0 +1,65 @@
+#ifndef WAD_STACK_H
+#define WAD_STACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wad.h"
+#include "wad-index.h"
+
+/* An IWAD with any number of PWADs on top, seen as a single WAD. */
+typedef struct {
+    WAD *wads;
+    Header *headers;
+    size_t n_wads;
+
+    /**
+     * Merged index over every WAD of the stack. Lump numbers are indices
+     * into index.lumps, and index.lumps[i].file says which WAD holds the
+     * lump. Pass the wads array and this index to find_map_lumps() to
+     * resolve maps across the whole stack.
+     */
+    WadIndex index;
+} WadStack;
+
+/**
+ * @brief Open several WAD files as a stack.
+ *
+ * Lumps of later WADs override lumps of earlier WADs with the same name.
+ *
+ * @param stack Pointer where to store the stack.
+ * @param paths The paths to the WAD files, IWAD first.
+ * @param n_paths Number of paths.
+ * @param mapped Whether to use load_wad_mapped() instead of load_wad().
+ * @returns 0 on success, 1 on failure.
+ */
+bool open_wad_stack(WadStack *stack, const char *const *paths, size_t n_paths, bool mapped);
+
+/**
+ * @brief Release every WAD of a stack and its index.
+ *
+ * @param stack Pointer to the stack.
+ */
+void close_wad_stack(WadStack *stack);
+
+/**
+ * @brief Get a view into the WAD that holds a lump, given its number.
+ *
+ * @param stack Pointer to the stack.
+ * @param lump The lump number.
+ * @param span Pointer where to store the view.
+ * @returns 0 on success, 1 if there is no such lump.
+ */
+bool wad_stack_lump_num(const WadStack *stack, uint32_t lump, WadSpan *span);
+
+/**
+ * @brief Get a view into the WAD that holds the winning lump of a name.
+ *
+ * @param stack Pointer to the stack.
+ * @param name The lump name.
+ * @param span Pointer where to store the view.
+ * @returns 0 on success, 1 if there is no such lump.
+ */
+bool wad_stack_lump(const WadStack *stack, const char *name, WadSpan *span);
+
+#endif // WAD_STACK_H
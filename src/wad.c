@@ -1,9 +1,18 @@
+#define _DEFAULT_SOURCE /* madvise() */
+
 #include "wad.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 bool load_wad(const char *wad_path, WAD *wad)
 {
     FILE *fptr;
@@ -11,12 +20,15 @@ bool load_wad(const char *wad_path, WAD *wad)
     long file_size;
     bool ret = 0;
 
+    wad->data = NULL;
+    wad->sz = 0;
+    wad->mapped = false;
+
     // TODO: check that it is safe to open wad_path
     fptr = fopen(wad_path, "rb");
     if (!fptr) {
         perror("Failed to open WAD file");
-        ret = 1;
-        goto exit_load;
+        return 1;
     }
 
     /* Get the size of the file. */
@@ -52,9 +64,86 @@ bool load_wad(const char *wad_path, WAD *wad)
 
 exit_load:
     fclose(fptr);
+    if (ret) {
+        free(wad->data);
+        wad->data = NULL;
+    }
     return ret;
 }
 
+bool load_wad_mapped(const char *wad_path, WAD *wad)
+{
+#if defined(_WIN32)
+    return load_wad(wad_path, wad);
+#else
+    struct stat st;
+    void *addr;
+    int fd;
+
+    fd = open(wad_path, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open WAD file");
+        return 1;
+    }
+
+    /* Empty files and special files cannot be mapped. */
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return load_wad(wad_path, wad);
+    }
+
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping keeps its own reference to the file. */
+    if (addr == MAP_FAILED)
+        return load_wad(wad_path, wad);
+
+    wad->data = (uint8_t *)addr;
+    wad->sz = (size_t)st.st_size;
+    wad->mapped = true;
+
+    /*
+     * Lumps are reached through the directory, so the access pattern is
+     * random: don't let the kernel read ahead the whole file. The header and
+     * the directory, on the other hand, are needed right away.
+     */
+    madvise(addr, wad->sz, MADV_RANDOM);
+    if (wad->sz >= 12) {
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        uint32_t num_directories, listing_offset;
+        memcpy(&num_directories, wad->data + 4, 4);
+        memcpy(&listing_offset, wad->data + 8, 4);
+
+        size_t begin = (size_t)listing_offset;
+        size_t end = begin + (size_t)num_directories * 16;
+        if (begin < wad->sz) {
+            if (end > wad->sz)
+                end = wad->sz;
+            begin &= ~(page - 1);
+            madvise(wad->data + begin, end - begin, MADV_WILLNEED);
+        }
+    }
+
+    return 0;
+#endif
+}
+
+void unload_wad(WAD *wad)
+{
+    if (!wad || !wad->data)
+        return;
+
+#if !defined(_WIN32)
+    if (wad->mapped)
+        munmap(wad->data, wad->sz);
+    else
+#endif
+        free(wad->data);
+
+    wad->data = NULL;
+    wad->sz = 0;
+    wad->mapped = false;
+}
+
 bool read_wad_uint8(const WAD *wad, uint8_t *dst, size_t offset)
 {
     /* Check for null pointers. */
@@ -127,50 +216,103 @@ bool read_wad_uint32(const WAD *wad, uint32_t *dst, size_t offset)
     return 0;
 }
 
-bool load_header(const WAD* wad, Header* header)
+WadError wad_span(const WAD *wad, const size_t offset, const size_t sz, WadSpan *span)
 {
-    /* Check for null pointers. */
-    if (!wad || !wad->data) {
-        fprintf(stderr, "Cannot load header from unloaded WAD or null pointer.\n");
-        return 1;
-    }
-    if (!header) {
-        fprintf(stderr, "Cannot load header into null pointer.\n");
-        return 1;
-    }
+    if (!wad || !wad->data || !span)
+        return WAD_ERR_NULL;
 
-    /* Check that there is actual data. */
-    if (wad->sz < 12) {
-        fprintf(stderr, "WAD file given does not contain a header.\n");
-        return 1;
-    }
+    /* Written so that it cannot overflow. */
+    if (offset > wad->sz || sz > wad->sz - offset)
+        return WAD_ERR_RANGE;
 
-    /* Read WAD type and add null terminator. */
-    for (size_t i = 0; i < 4; i++) {
-        if (read_wad_uint8(wad, (uint8_t *)header->wad_type + i, i)) {
-            fprintf(stderr, "Could not read WAD type.\n");
-            return 1;
-        }
-    }
+    span->data = wad->data + offset;
+    span->sz = sz;
+
+    return WAD_OK;
+}
+
+WadError wad_span_records(const WAD *wad, const size_t offset, const size_t count,
+        const size_t record_sz, WadSpan *span)
+{
+    if (record_sz && count > SIZE_MAX / record_sz)
+        return WAD_ERR_RANGE;
+
+    return wad_span(wad, offset, count * record_sz, span);
+}
+
+WadError wad_lump_span(const WAD *wad, const Directory *directory,
+        const size_t record_sz, WadSpan *span)
+{
+    if (!directory)
+        return WAD_ERR_NULL;
+    if (!record_sz || directory->lump_size % record_sz)
+        return WAD_ERR_FORMAT;
+
+    return wad_span(wad, directory->lump_offset, directory->lump_size, span);
+}
+
+WadError read_header(const WAD *wad, Header *header)
+{
+    WadSpan span;
+    WadError err;
+
+    if (!header)
+        return WAD_ERR_NULL;
+    if ((err = wad_span(wad, 0, WAD_HEADER_SIZE, &span)))
+        return err;
+
+    for (size_t i = 0; i < 4; i++)
+        header->wad_type[i] = (char)span_u8(span, i);
     header->wad_type[4] = '\0';
 
     /* Check that it is a valid WAD type. */
-    bool IWAD = strncmp(header->wad_type, "IWAD", 4);
-    bool PWAD = strncmp(header->wad_type, "PWAD", 4);
-    if (!IWAD && !PWAD) {
-        fprintf(stderr, "Invalid WAD type read.\n");
-        return 1;
-    }
+    if (strcmp(header->wad_type, "IWAD") && strcmp(header->wad_type, "PWAD"))
+        return WAD_ERR_FORMAT;
 
-    /* Read number of directories. */
-    if (read_wad_uint32(wad, &header->num_directories, 4)) {
-        fprintf(stderr, "Could not read number of directories.\n");
-        return 1;
+    header->num_directories = span_u32(span, 4);
+    header->listing_offset = span_u32(span, 8);
+
+    return WAD_OK;
+}
+
+WadError read_directories(const WAD *wad, const Header *header, Directory *directories)
+{
+    WadSpan span;
+    WadError err;
+
+    if (!header || !directories)
+        return WAD_ERR_NULL;
+    if ((err = wad_span_records(wad, header->listing_offset,
+                    header->num_directories, WAD_DIRECTORY_SIZE, &span)))
+        return err;
+
+    for (size_t i = 0; i < header->num_directories; i++)
+        span_directory(span, i * WAD_DIRECTORY_SIZE, &directories[i]);
+
+    return WAD_OK;
+}
+
+const char *wad_strerror(const WadError err)
+{
+    switch (err) {
+        case WAD_OK:
+            return "Success";
+        case WAD_ERR_NULL:
+            return "Unloaded WAD or null pointer";
+        case WAD_ERR_RANGE:
+            return "Data extends beyond WAD size";
+        case WAD_ERR_FORMAT:
+            return "Malformed WAD data";
     }
 
-    /* Read offset of listing. */
-    if (read_wad_uint32(wad, &header->listing_offset, 8)) {
-        fprintf(stderr, "Could not read offset of listing.\n");
+    return "Unknown error";
+}
+
+bool load_header(const WAD* wad, Header* header)
+{
+    const WadError err = read_header(wad, header);
+    if (err) {
+        fprintf(stderr, "Could not load WAD header: %s.\n", wad_strerror(err));
         return 1;
     }
 
@@ -179,36 +321,19 @@ bool load_header(const WAD* wad, Header* header)
 
 bool load_directory(const WAD* wad, Directory* directory, size_t offset)
 {
-    /* Check for null pointers. */
-    if (!wad || !wad->data) {
-        fprintf(stderr, "Cannot load header from unloaded WAD or null pointer.\n");
-        return 1;
-    }
-    if (!directory) {
-        fprintf(stderr, "Cannot load directory into null pointer.\n");
-        return 1;
-    }
-
-    /* Read offset of lump. */
-    if (read_wad_uint32(wad, &directory->lump_offset, offset)) {
-        fprintf(stderr, "Could not read lump offset for directory.\n");
-        return 1;
-    }
+    WadSpan span;
+    WadError err;
 
-    /* Read size of lump. */
-    if (read_wad_uint32(wad, &directory->lump_size, offset + 4)) {
-        fprintf(stderr, "Could not read lump size for directory.\n");
+    if (!directory)
+        err = WAD_ERR_NULL;
+    else
+        err = wad_span(wad, offset, WAD_DIRECTORY_SIZE, &span);
+    if (err) {
+        fprintf(stderr, "Could not load WAD directory: %s.\n", wad_strerror(err));
         return 1;
     }
 
-    /* Read name of lump. */
-    for (size_t i = 0; i < 8; i++) {
-        if (read_wad_uint8(wad, (uint8_t *)directory->lump_name + i, offset + 8 + i)) {
-            fprintf(stderr, "Could not read lump name.\n");
-            return 1;
-        }
-    }
-    directory->lump_name[8] = '\0';
+    span_directory(span, 0, directory);
 
     return 0;
-}
\ No newline at end of file
+}
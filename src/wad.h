@@ -1,6 +1,7 @@
 #ifndef WAD_LOADER_H
 #define WAD_LOADER_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -8,6 +9,7 @@
 typedef struct {
     uint8_t *data;
     size_t sz;
+    bool mapped; /* data is a read-only file mapping, not a heap buffer */
 } WAD;
 
 /* Header. */
@@ -24,6 +26,28 @@ typedef struct {
     char lump_name[9];
 } Directory;
 
+/* Error codes of the span readers. */
+typedef enum {
+    WAD_OK = 0,
+    WAD_ERR_NULL,   /* unloaded WAD or null pointer */
+    WAD_ERR_RANGE,  /* range extends beyond WAD size */
+    WAD_ERR_FORMAT, /* data is not what it should be */
+} WadError;
+
+/**
+ * Range of WAD bytes that has been checked to exist. Once a span has been
+ * obtained, its fields are decoded with the span_*() helpers below without
+ * any further checks.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t sz;
+} WadSpan;
+
+/* Size in bytes of a header and of a directory entry. */
+#define WAD_HEADER_SIZE 12
+#define WAD_DIRECTORY_SIZE 16
+
 /**
  * @brief Load the WAD into memory, given the path to the WAD file.
  * 
@@ -33,6 +57,26 @@ typedef struct {
  */
 bool load_wad(const char *path, WAD *wad);
 
+/**
+ * @brief Map the WAD read-only into memory, given the path to the WAD file.
+ *
+ * The file is mapped private and read-only, so the pages are shared with
+ * every other process mapping the same WAD and are only faulted in when
+ * touched. Falls back to load_wad() if the file cannot be mapped.
+ *
+ * @param path The path to the WAD file.
+ * @param wad Pointer where to store the loaded WAD.
+ * @returns 0 on success, 1 on failure.
+ */
+bool load_wad_mapped(const char *path, WAD *wad);
+
+/**
+ * @brief Release a WAD loaded by load_wad() or load_wad_mapped().
+ *
+ * @param wad Pointer to loaded WAD.
+ */
+void unload_wad(WAD *wad);
+
 /**
  * @brief Read one byte from the WAD into another variable.
  * 
@@ -81,4 +125,115 @@ bool load_header(const WAD* wad, Header* header);
  */
 bool load_directory(const WAD* wad, Directory* directory, size_t offset);
 
+/**
+ * @brief Get a span over a range of the WAD, checking the range once.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param offset Offset of the first byte of the range.
+ * @param sz Size of the range in bytes.
+ * @param span Pointer where to store the span.
+ * @returns WAD_OK on success, an error code on failure.
+ */
+WadError wad_span(const WAD *wad, size_t offset, size_t sz, WadSpan *span);
+
+/**
+ * @brief Get a span over count records of record_sz bytes each.
+ *
+ * Same as wad_span(), but safe against overflow of count * record_sz.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param offset Offset of the first record.
+ * @param count Number of records.
+ * @param record_sz Size of one record in bytes.
+ * @param span Pointer where to store the span.
+ * @returns WAD_OK on success, an error code on failure.
+ */
+WadError wad_span_records(const WAD *wad, size_t offset, size_t count,
+        size_t record_sz, WadSpan *span);
+
+/**
+ * @brief Get a span over a whole lump made of records of record_sz bytes.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param directory Pointer to the directory entry of the lump.
+ * @param record_sz Size of one record in bytes, or 1 for raw lumps.
+ * @param span Pointer where to store the span.
+ * @returns WAD_OK on success, WAD_ERR_FORMAT if the lump size is not a
+ *          multiple of record_sz, another error code on failure.
+ */
+WadError wad_lump_span(const WAD *wad, const Directory *directory,
+        size_t record_sz, WadSpan *span);
+
+/**
+ * @brief Decode the header at the start of the WAD.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param header Pointer where to store the header.
+ * @returns WAD_OK on success, an error code on failure.
+ */
+WadError read_header(const WAD *wad, Header *header);
+
+/**
+ * @brief Decode the whole directory of the WAD, checking its range once.
+ *
+ * @param wad Pointer to loaded WAD.
+ * @param header Pointer to the header of the WAD.
+ * @param directories Array of header->num_directories entries to fill.
+ * @returns WAD_OK on success, an error code on failure.
+ */
+WadError read_directories(const WAD *wad, const Header *header, Directory *directories);
+
+/**
+ * @brief Get a human readable description of an error code.
+ *
+ * @param err The error code.
+ * @returns A static string.
+ */
+const char *wad_strerror(WadError err);
+
+/* Unchecked little-endian decoders; offsets are relative to the span. */
+
+static inline uint8_t span_u8(const WadSpan span, const size_t offset)
+{
+    return span.data[offset];
+}
+
+static inline uint16_t span_u16(const WadSpan span, const size_t offset)
+{
+    return (uint16_t)(span.data[offset] | (span.data[offset + 1] << 8));
+}
+
+static inline int16_t span_i16(const WadSpan span, const size_t offset)
+{
+    return (int16_t)span_u16(span, offset);
+}
+
+static inline uint32_t span_u32(const WadSpan span, const size_t offset)
+{
+    return (uint32_t)span.data[offset]
+        | ((uint32_t)span.data[offset + 1] << 8)
+        | ((uint32_t)span.data[offset + 2] << 16)
+        | ((uint32_t)span.data[offset + 3] << 24);
+}
+
+/**
+ * Copy an 8 byte name field and null-terminate it.
+ */
+static inline void span_name(const WadSpan span, const size_t offset, char name[9])
+{
+    for (size_t i = 0; i < 8; i++)
+        name[i] = (char)span.data[offset + i];
+    name[8] = '\0';
+}
+
+/**
+ * Decode the directory entry at the given offset of the span.
+ */
+static inline void span_directory(const WadSpan span, const size_t offset, Directory *directory)
+{
+    directory->lump_offset = span_u32(span, offset);
+    directory->lump_size = span_u32(span, offset + 4);
+    span_name(span, offset + 8, directory->lump_name);
+}
+
 #endif // WAD_LOADER_H